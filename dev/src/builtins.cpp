@@ -19,10 +19,205 @@
 
 #include "unicode.h"
 
+#ifdef PLATFORM_SSE2
+    #include <emmintrin.h>
+#endif
+
 using namespace lobster;
 
 static RandomNumberGenerator<MersenneTwister> rnd;
 
+// Generators created by rng_new are a vector of 4 ints holding the 64-bit PCG32 state and stream, so they are
+// just values: they can be kept per entity or coroutine, copied to fork a sequence, or serialized.
+struct RngState
+{
+    LVector *v;
+    PCG32 pcg;
+
+    // Releases rng when raising an error, so construct this before allocating anything that could leak.
+    RngState(Value &rng) : v((LVector *)rng.eval())
+    {
+        if (v->Len() != 4)
+        {
+            rng.DECRT();
+            g_vm->BuiltinError("rng: not a generator created by rng_new");
+        }
+        pcg = PCG32(Get(0), Get(2));
+    }
+
+    ~RngState()
+    {
+        Set(0, pcg.State());
+        Set(2, pcg.Inc());
+    }
+
+    uint64_t Get(int i) { return (uint64_t)(uint)v->At(i).ival() | ((uint64_t)(uint)v->At(i + 1).ival() << 32); }
+    void Set(int i, uint64_t x) { v->At(i) = Value((int)(uint)x); v->At(i + 1) = Value((int)(uint)(x >> 32)); }
+};
+
+// Maps a random uint32 onto [0..max) with a multiply instead of a division.
+static int RngInt(uint32_t r, int max) { return (int)(((uint64_t)r * (uint)max) >> 32); }
+// [0..1), using only as many bits as a float has, so it can't round up to 1.
+static float RngFloat(uint32_t r) { return (r >> 8) * (1.0f / 16777216.0f); }
+// Box-Muller: turns 2 uniform numbers into 2 normally distributed ones.
+static void RngNormals(uint32_t r1, uint32_t r2, float &n1, float &n2)
+{
+    auto radius = sqrtf(-2 * logf(((r1 >> 8) + 1) * (1.0f / 16777216.0f)));
+    auto angle = RngFloat(r2) * 2 * PI;
+    n1 = radius * cosf(angle);
+    n2 = radius * sinf(angle);
+}
+
+// Bulk versions of rng_float / rng_normal, shared by the overloads with and without a range.
+static Value RngFloats(Value &rng, int n, float lo, float hi)
+{
+    auto len = max(0, n);
+    auto range = hi - lo;
+    LVector *v;
+    {
+        RngState st(rng);
+        v = (LVector *)g_vm->NewVector(len, len, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_FLOAT));
+        st.pcg.Generate(len, [&](size_t i, uint32_t r) { v->At((int)i) = Value(lo + RngFloat(r) * range); });
+    }
+    rng.DECRT();
+    return Value(v);
+}
+
+static Value RngNormalVector(Value &rng, int n, float mean, float deviation)
+{
+    auto len = max(0, n);
+    LVector *v;
+    {
+        RngState st(rng);
+        v = (LVector *)g_vm->NewVector(len, len, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_FLOAT));
+        // Each pair of random numbers gives 2 results, so this does not match calling rng_normal n times.
+        uint32_t first = 0;
+        st.pcg.Generate(len + (len & 1), [&](size_t i, uint32_t r)
+        {
+            if (!(i & 1)) { first = r; return; }
+            float n1, n2;
+            RngNormals(first, r, n1, n2);
+            v->At((int)i - 1) = Value(mean + n1 * deviation);
+            if ((int)i < len) v->At((int)i) = Value(mean + n2 * deviation);
+        });
+    }
+    rng.DECRT();
+    return Value(v);
+}
+
+// Bulk math over whole [int] / [float] vectors. In release builds vector elements are plain pointer-sized scalars,
+// so the kernels below read them directly as an array. With RTT_ENABLED each element also carries its type, so they
+// are copied out first.
+template<typename T> class ScalarElems
+{
+    #if RTT_ENABLED
+        vector<T> copy;
+    #endif
+
+    public:
+
+    const T *p;
+    int len;
+
+    ScalarElems(Value &vec) : p(nullptr), len(vec.eval()->Len())
+    {
+        if (!len) return;
+        #if RTT_ENABLED
+            for (int i = 0; i < len; i++)
+            {
+                auto &e = vec.eval()->At(i);
+                copy.push_back(e.type == V_FLOAT ? (T)e.fval() : (T)e.ival());
+            }
+            p = copy.data();
+        #else
+            static_assert(sizeof(Value) == sizeof(T), "vector elements must be plain scalars");
+            p = (const T *)&vec.eval()->At(0);
+        #endif
+    }
+};
+
+// Sum of n elements, using 4 independent accumulators, so additions don't have to wait on each other. For floats
+// this also rounds less than a running total.
+template<typename T> T BulkSum(const T *p, int n)
+{
+    T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4) { s0 += p[i]; s1 += p[i + 1]; s2 += p[i + 2]; s3 += p[i + 3]; }
+    for (; i < n; i++) s0 += p[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+template<typename T> T BulkDot(const T *a, const T *b, int n)
+{
+    T s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; i++) s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+#ifdef PLATFORM_SSE2
+template<> double BulkSum(const double *p, int n)
+{
+    auto s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(p + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(p + i + 2));
+    }
+    double r[2];
+    _mm_storeu_pd(r, _mm_add_pd(s0, s1));
+    auto s = r[0] + r[1];
+    for (; i < n; i++) s += p[i];
+    return s;
+}
+
+template<> double BulkDot(const double *a, const double *b, int n)
+{
+    auto s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    double r[2];
+    _mm_storeu_pd(r, _mm_add_pd(s0, s1));
+    auto s = r[0] + r[1];
+    for (; i < n; i++) s += a[i] * b[i];
+    return s;
+}
+#endif
+
+// Index of the first smallest (or with largest, the first largest) element, or -1 if there are none. Tracks 4
+// candidates in parallel, then picks between them, preferring the lowest index on ties.
+template<typename T> int BulkMinIndex(const T *p, int n, bool largest)
+{
+    if (!n) return -1;
+    T sign = largest ? -1 : 1;
+    int best[4] = { 0, 0, 0, 0 };
+    int i = 0;
+    if (n >= 4)
+    {
+        for (int j = 0; j < 4; j++) best[j] = j;
+        for (i = 4; i + 4 <= n; i += 4)
+            for (int j = 0; j < 4; j++)
+                if (p[i + j] * sign < p[best[j]] * sign) best[j] = i + j;
+    }
+    int r = best[0];
+    for (int j = 1; j < 4; j++)
+        if (p[best[j]] * sign < p[r] * sign || (p[best[j]] == p[r] && best[j] < r)) r = best[j];
+    for (; i < n; i++) if (p[i] * sign < p[r] * sign) r = i;
+    return r;
+}
+
 static int IntCompare(const Value &a, const Value &b)
 {
     return a.ival() < b.ival() ? -1 : a.ival() > b.ival();
@@ -69,6 +264,55 @@ template<typename T> Value BinarySearch(Value &l, Value &key, T comparefun)
     return Value(i);
 }
 
+// Map ints and floats to unsigned keys that sort in the same order.
+static uint IntSortKey(const Value &v)
+{
+    return (uint)v.ival() ^ 0x80000000;
+}
+
+static uint FloatSortKey(const Value &v)
+{
+    auto f = v.fval();
+    uint u;
+    memcpy(&u, &f, sizeof(uint));
+    return u & 0x80000000 ? ~u : u | 0x80000000;
+}
+
+// Stable LSD radix sort of vector l by the keys of vector k (which may be l itself), reordering both.
+template<typename T> void RadixSort(LVector *l, LVector *k, T keyfun)
+{
+    auto len = l->len;
+    if (len < 2) return;
+    vector<pair<uint, int>> a(len), b(len);
+    for (int i = 0; i < len; i++) a[i] = make_pair(keyfun(k->At(i)), i);
+    if (len < 64)
+    {
+        stable_sort(a.begin(), a.end(), [](const pair<uint, int> &x, const pair<uint, int> &y)
+        {
+            return x.first < y.first;
+        });
+    }
+    else
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+        {
+            int counts[257] = { 0 };
+            for (auto &e : a) counts[((e.first >> shift) & 0xFF) + 1]++;
+            if (counts[((a[0].first >> shift) & 0xFF) + 1] == len) continue;  // All in one bucket.
+            for (int i = 0; i < 256; i++) counts[i + 1] += counts[i];
+            for (auto &e : a) b[counts[(e.first >> shift) & 0xFF]++] = e;
+            a.swap(b);
+        }
+    }
+    auto permute = [&](LVector *v)
+    {
+        vector<Value> tmp(&v->At(0), &v->At(0) + len);
+        for (int i = 0; i < len; i++) v->At(i) = tmp[a[i].second];
+    };
+    permute(l);
+    if (k != l) permute(k);
+}
+
 // int <-> float
 const TypeInfo &SwapVectType(const TypeInfo *available, const TypeInfo &existing)
 {
@@ -87,11 +331,154 @@ void RealVector(Value &v)
         g_vm->BuiltinError("vector operation cannot use struct");
 }
 
+// A* over a grid of per cell costs (<= 0 is impassable), returns the path from end to start as cell indices, or
+// an empty vector if there is none. Outdated entries in the open list are skipped rather than updated in place.
+static LVector *AStarGrid(LVector *costs, int width, const int2 &start, const int2 &end, bool diagonal)
+{
+    auto path = (LVector *)g_vm->NewVector(0, 0, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_INT));
+    int size = costs->len;
+    int height = size / width;
+    auto valid = [&](int x, int y) { return x >= 0 && y >= 0 && x < width && y < height; };
+    if (!valid(start.x(), start.y()) || !valid(end.x(), end.y())) return path;
+
+    // Scale the heuristic by the cheapest cell, so it never overestimates.
+    float mincost = FLT_MAX;
+    for (int i = 0; i < size; i++) if (costs->At(i).ival() > 0) mincost = min(mincost, (float)costs->At(i).ival());
+    const float diagcost = sqrtf(2.0f);
+    auto heuristic = [&](int c)
+    {
+        int dx = abs(c % width - end.x());
+        int dy = abs(c / width - end.y());
+        return mincost * (diagonal ? max(dx, dy) + (diagcost - 1) * min(dx, dy) : dx + dy);
+    };
+
+    vector<float> g(size, FLT_MAX);
+    vector<int> from(size, -1);
+    vector<char> closed(size, 0);
+    typedef pair<float, int> Open;
+    vector<Open> open;
+    int s = start.x() + start.y() * width;
+    int e = end.x() + end.y() * width;
+    g[s] = 0;
+    open.push_back(Open(heuristic(s), s));
+    static const int dirs[8][2] = { { 1, 0 }, { 0, 1 }, { -1, 0 }, { 0, -1 }, { 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 } };
+    while (!open.empty())
+    {
+        pop_heap(open.begin(), open.end(), greater<Open>());
+        int c = open.back().second;
+        open.pop_back();
+        if (closed[c]) continue;
+        closed[c] = 1;
+        if (c == e) break;
+        int cx = c % width, cy = c / width;
+        for (int d = 0; d < (diagonal ? 8 : 4); d++)
+        {
+            int nx = cx + dirs[d][0], ny = cy + dirs[d][1];
+            if (!valid(nx, ny)) continue;
+            int n = nx + ny * width;
+            int cost = costs->At(n).ival();
+            if (cost <= 0 || closed[n]) continue;
+            float ng = g[c] + cost * (d < 4 ? 1 : diagcost);
+            if (ng < g[n])
+            {
+                g[n] = ng;
+                from[n] = c;
+                open.push_back(Open(ng + heuristic(n), n));
+                push_heap(open.begin(), open.end(), greater<Open>());
+            }
+        }
+    }
+
+    if (closed[e]) for (int c = e; c >= 0; c = from[c]) path->Push(Value(c));
+    return path;
+}
+
+// A set of bytes to scan for, such as the delimiters in tokenize. Sets of up to 8 bytes are matched against 16
+// bytes of input at a time, anything else (and the tail) goes through a lookup table.
+struct CharSet
+{
+    bool in[256];
+    const char *chars;
+    size_t num;
+
+    CharSet(const char *_chars, size_t _num) : chars(_chars), num(_num)
+    {
+        memset(in, 0, sizeof(in));
+        for (size_t i = 0; i < num; i++) in[(uchar)chars[i]] = true;
+    }
+
+    // returns the first position in [p, end) holding a byte from the set, or end
+    const char *Find(const char *p, const char *end) const
+    {
+        #ifdef PLATFORM_SSE2
+            if (num && num <= 8)
+            {
+                __m128i sets[8];
+                for (size_t i = 0; i < num; i++) sets[i] = _mm_set1_epi8(chars[i]);
+                for (; end - p >= 16; p += 16)
+                {
+                    auto block = _mm_loadu_si128((const __m128i *)p);
+                    auto hits = _mm_cmpeq_epi8(block, sets[0]);
+                    for (size_t i = 1; i < num; i++) hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, sets[i]));
+                    auto mask = _mm_movemask_epi8(hits);
+                    if (mask) return p + LowestBit(mask);
+                }
+            }
+        #endif
+        while (p < end && !in[(uchar)*p]) p++;
+        return p;
+    }
+
+    // returns the first position in [p, end) holding a byte not in the set, or end
+    const char *Skip(const char *p, const char *end) const
+    {
+        while (p < end && in[(uchar)*p]) p++;
+        return p;
+    }
+};
+
+// Returns the index of the first occurrence of needle in s at or after start, or -1.
+static int FindString(const char *s, int len, const char *needle, int nlen, int start)
+{
+    if (!nlen) return start;
+    if (nlen > len - start) return -1;
+    auto p = s + start;
+    auto last = s + len - nlen;  // last position an occurrence can start at
+    #ifdef PLATFORM_SSE2
+        // Test 16 positions at once on both the first and last byte of needle, and only compare the whole needle
+        // where both match. All loads stay inside s as long as p + 15 <= last.
+        auto first = _mm_set1_epi8(needle[0]);
+        auto lastc = _mm_set1_epi8(needle[nlen - 1]);
+        for (; last - p >= 15; p += 16)
+        {
+            auto mask = _mm_movemask_epi8(_mm_and_si128(
+                _mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i *)p)),
+                _mm_cmpeq_epi8(lastc, _mm_loadu_si128((const __m128i *)(p + nlen - 1)))));
+            while (mask)
+            {
+                auto i = LowestBit(mask);
+                if (!memcmp(p + i, needle, nlen)) return int(p + i - s);
+                mask &= mask - 1;
+            }
+        }
+    #endif
+    while (p <= last)
+    {
+        p = (const char *)memchr(p, needle[0], last - p + 1);
+        if (!p) return -1;
+        if (!memcmp(p, needle, nlen)) return int(p - s);
+        p++;
+    }
+    return -1;
+}
+
 void AddBuiltins()
 {
     STARTDECL(print) (Value &a)
     {
-        Output(OUTPUT_PROGRAM, RefToString(a.ref(), g_vm->programprintprefs).c_str());
+        g_vm->printbuf.clear();
+        RefToString(g_vm->printbuf, a.ref(), g_vm->programprintprefs);
+        Output(OUTPUT_PROGRAM, g_vm->printbuf.c_str());
         return a;
     }
     ENDDECL1(print, "x", "A", "A1",
@@ -101,7 +488,9 @@ void AddBuiltins()
     {
         if (a.ref() && &a.ref()->ti == &g_vm->GetTypeInfo(TYPE_ELEM_STRING)) return a;
 
-        auto str = g_vm->NewString(RefToString(a.ref(), g_vm->programprintprefs));
+        g_vm->printbuf.clear();
+        RefToString(g_vm->printbuf, a.ref(), g_vm->programprintprefs);
+        auto str = g_vm->NewString(g_vm->printbuf);
         a.DECRT();
         return str;
     }
@@ -216,6 +605,12 @@ void AddBuiltins()
     ENDDECL1(length, "xs", "V*", "I",
         "length of vector");
 
+    // Scalar versions first, so these don't get boxed to match the any version.
+    STARTDECL(equal) (Value &a, Value &b) { return Value(a.ival() == b.ival()); } ENDDECL2(equal, "a,b", "II", "I",
+        "int version.");
+    STARTDECL(equal) (Value &a, Value &b) { return Value(a.fval() == b.fval()); } ENDDECL2(equal, "a,b", "FF", "I",
+        "float version.");
+
     STARTDECL(equal) (Value &a, Value &b)
     {
         bool eq = RefEqual(a.refnil(), b.refnil(), true);
@@ -227,6 +622,22 @@ void AddBuiltins()
         "structural equality between any two values (recurses into vectors/objects,"
         " unlike == which is only true for vectors/objects if they are the same object)");
 
+    #define HASHINT(h) Value((int)((h) ^ ((h) >> 32)))
+    STARTDECL(hash) (Value &a) { return HASHINT(a.Hash(V_INT)); } ENDDECL1(hash, "x", "I", "I",
+        "hashes an int, see the any version.");
+    STARTDECL(hash) (Value &a) { return HASHINT(a.Hash(V_FLOAT)); } ENDDECL1(hash, "x", "F", "I",
+        "hashes a float, see the any version.");
+    STARTDECL(hash) (Value &a)
+    {
+        auto h = RefHash(a.refnil());
+        a.DECRTNIL();
+        return HASHINT(h);
+    }
+    ENDDECL1(hash, "x", "A", "I",
+        "hashes any value structurally (recurses into vectors/objects), such that values that are equal()"
+        " have the same hash. See dictionary.lobster and cache.lobster for hash tables built on this.");
+    #undef HASHINT
+
     STARTDECL(push) (Value &l, Value &x)
     {
         RealVector(l);
@@ -354,6 +765,72 @@ void AddBuiltins()
     ENDDECL2(binarysearch, "xs,key", "S]S", "II",
         "string version.");
 
+    STARTDECL(sort) (Value &l)
+    {
+        RealVector(l);
+        RadixSort(l.vval(), l.vval(), IntSortKey);
+        return l;
+    }
+    ENDDECL1(sort, "xs", "I]", "I]",
+        "sorts an int vector in place (ascending), returns the same vector."
+        " For sorting with a comparison function, see qsort and qsort_in_place in std.lobster");
+
+    STARTDECL(sort) (Value &l)
+    {
+        RealVector(l);
+        RadixSort(l.vval(), l.vval(), FloatSortKey);
+        return l;
+    }
+    ENDDECL1(sort, "xs", "F]", "F]",
+        "float version.");
+
+    STARTDECL(sort) (Value &l)
+    {
+        RealVector(l);
+        auto v = l.vval();
+        if (v->len) sort(&v->At(0), &v->At(0) + v->len, [](const Value &a, const Value &b)
+        {
+            return StringCompare(a, b) < 0;
+        });
+        return l;
+    }
+    ENDDECL1(sort, "xs", "S]", "S]",
+        "string version.");
+
+    STARTDECL(sort_by) (Value &l, Value &keys)
+    {
+        RealVector(l);
+        if (l.vval()->len != keys.vval()->len)
+        {
+            l.DECRT();
+            keys.DECRT();
+            g_vm->BuiltinError("sort_by: xs and keys must be equal length");
+        }
+        RadixSort(l.vval(), keys.vval(), IntSortKey);
+        keys.DECRT();
+        return l;
+    }
+    ENDDECL2(sort_by, "xs,keys", "V*I]", "V1",
+        "sorts xs in place such that the corresponding int keys are ascending, e.g."
+        " sort_by(entities, map(entities): _.depth). keys are sorted along with it."
+        " The sort is stable: elements with equal keys keep their order. Returns xs.");
+
+    STARTDECL(sort_by) (Value &l, Value &keys)
+    {
+        RealVector(l);
+        if (l.vval()->len != keys.vval()->len)
+        {
+            l.DECRT();
+            keys.DECRT();
+            g_vm->BuiltinError("sort_by: xs and keys must be equal length");
+        }
+        RadixSort(l.vval(), keys.vval(), FloatSortKey);
+        keys.DECRT();
+        return l;
+    }
+    ENDDECL2(sort_by, "xs,keys", "V*F]", "V1",
+        "float keys version.");
+
     STARTDECL(copy) (Value &v)
     {
         auto len = v.eval()->Len();
@@ -455,19 +932,18 @@ void AddBuiltins()
     STARTDECL(tokenize) (Value &s, Value &delims, Value &whitespace)
     {
         auto v = (LVector *)g_vm->NewVector(0, 0, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_STRING));
-        auto ws = whitespace.sval()->str();
-        auto dl = delims.sval()->str();
-        auto p = s.sval()->str();
-        p += strspn(p, ws);
-        auto strspn1 = [](char c, const char *set) { while (*set) if (*set == c) return 1; return 0; };
-        while (*p)
+        CharSet ws(whitespace.sval()->str(), whitespace.sval()->len);
+        CharSet dl(delims.sval()->str(), delims.sval()->len);
+        const char *p = s.sval()->str();
+        auto send = p + s.sval()->len;
+        p = ws.Skip(p, send);
+        while (p < send)
         {
-            auto delim = p + strcspn(p, dl);
+            auto delim = dl.Find(p, send);
             auto end = delim;
-            while (end > p && strspn1(end[-1], ws)) end--;
+            while (end > p && ws.in[(uchar)end[-1]]) end--;
             v->Push(g_vm->NewString(p, end - p));
-            p = delim + strspn(delim, dl);
-            p += strspn(p, ws);
+            p = ws.Skip(dl.Skip(delim, send), send);
         }
         s.DECRT();
         delims.DECRT();
@@ -479,39 +955,119 @@ void AddBuiltins()
         " delimiter. Segments are stripped of leading and trailing whitespace."
         " Example: \"; A ; B C; \" becomes [ \"\", \"A\", \"B C\" ] with \";\" as delimiter and \" \" as whitespace." );
 
+    STARTDECL(find_string) (Value &s, Value &sub, Value &start)
+    {
+        if (start.ival() < 0 || start.ival() > s.sval()->len)
+        {
+            s.DECRT();
+            sub.DECRT();
+            g_vm->BuiltinError("find_string: start out of range");
+        }
+        auto i = FindString(s.sval()->str(), s.sval()->len, sub.sval()->str(), sub.sval()->len, start.ival());
+        s.DECRT();
+        sub.DECRT();
+        return Value(i);
+    }
+    ENDDECL3(find_string, "s,substring,start", "SSI?", "I",
+        "returns the index of the first occurrence of substring in s at or after index start (default 0),"
+        " or -1 if there is none.");
+
+    STARTDECL(find_all) (Value &s, Value &sub)
+    {
+        if (!sub.sval()->len)
+        {
+            s.DECRT();
+            sub.DECRT();
+            g_vm->BuiltinError("find_all: empty substring");
+        }
+        auto v = (LVector *)g_vm->NewVector(0, 0, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_INT));
+        auto len = s.sval()->len;
+        auto nlen = sub.sval()->len;
+        for (int i = 0; (i = FindString(s.sval()->str(), len, sub.sval()->str(), nlen, i)) >= 0; i += nlen)
+            v->Push(Value(i));
+        s.DECRT();
+        sub.DECRT();
+        return Value(v);
+    }
+    ENDDECL2(find_all, "s,substring", "SS", "I]",
+        "returns the indices of all non-overlapping occurrences of substring in s.");
+
     STARTDECL(unicode2string) (Value &v)
     {
-        char buf[7];
-        string s;
-        for (int i = 0; i < v.eval()->Len(); i++)
+        // Size the string exactly first, then encode straight into it.
+        auto len = v.eval()->Len();
+        size_t size = 0;
+        for (int i = 0; i < len; i++)
         {
-            auto &c = v.eval()->At(i);
-            TYPE_ASSERT(c.type == V_INT);
-            ToUTF8(c.ival(), buf);
-            s += buf;
+            auto u = v.eval()->At(i).ival();
+            if (u < 0) { v.DECRT(); g_vm->BuiltinError("unicode2string: negative unicode value"); }
+            size += UTF8EncodedLen(u);
         }
+        auto s = g_vm->NewString(size);
+        auto p = s->str();
+        for (int i = 0; i < len; i++)
+        {
+            auto u = v.eval()->At(i).ival();
+            if (u < 0x80) *p++ = (char)u;
+            else p += ToUTF8(u, p);
+        }
+        *p = 0;
         v.DECRT();
-        return Value(g_vm->NewString(s));
+        return Value(s);
     }
     ENDDECL1(unicode2string, "us", "I]", "S",
         "converts a vector of ints representing unicode values to a UTF-8 string.");
 
     STARTDECL(string2unicode) (Value &s)
     {
-        auto v = (LVector *)g_vm->NewVector(0, s.sval()->len, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_INT));
-        const char *p = s.sval()->str();
-        while (*p)
-        {
-            int u = FromUTF8(p);
-            if (u < 0) { s.DECRT(); Value(v).DECRT(); return Value(); }
-            v->Push(u);
-        }
+        // Validating first gives the exact length, and lets the decoding loop skip all checks.
+        auto num = UTF8Length(s.sval()->str(), s.sval()->len);
+        if (num < 0) { s.DECRT(); return Value(); }
+        auto v = (LVector *)g_vm->NewVector(num, num, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_INT));
+        auto p = (const uchar *)s.sval()->str();
+        for (int i = 0; i < num; i++) v->At(i) = Value(*p < 0x80 ? *p++ : DecodeUTF8(p));
         s.DECRT();
         return Value(v);
     }
     ENDDECL1(string2unicode, "s", "S", "I]?",
         "converts a UTF-8 string into a vector of unicode values, or nil upon a decoding error");
 
+    STARTDECL(utf8_length) (Value &s)
+    {
+        auto num = UTF8Length(s.sval()->str(), s.sval()->len);
+        s.DECRT();
+        return Value(num);
+    }
+    ENDDECL1(utf8_length, "s", "S", "I",
+        "returns the number of unicode values in a UTF-8 string (without converting it), or -1 upon a decoding"
+        " error");
+
+    STARTDECL(utf8_offset) (Value &s, Value &i)
+    {
+        auto offset = UTF8Offset(s.sval()->str(), s.sval()->len, i.ival());
+        s.DECRT();
+        return Value(offset);
+    }
+    ENDDECL2(utf8_offset, "s,i", "SI", "I",
+        "returns the byte index at which unicode value i starts in a UTF-8 string, the string length if i is the"
+        " number of unicode values, or -1 if i is out of range. use with substring() to slice by unicode value.");
+
+    STARTDECL(utf8_char) (Value &s, Value &i)
+    {
+        auto offset = UTF8Offset(s.sval()->str(), s.sval()->len, i.ival());
+        int u = -1;
+        if (offset >= 0 && offset < s.sval()->len)
+        {
+            const char *p = s.sval()->str() + offset;
+            u = FromUTF8(p);
+        }
+        s.DECRT();
+        return Value(u);
+    }
+    ENDDECL2(utf8_char, "s,i", "SI", "I",
+        "returns unicode value i of a UTF-8 string (without converting all of it), or -1 if i is out of range or"
+        " upon a decoding error");
+
     STARTDECL(number2string) (Value &n, Value &b, Value &mc)
     {
         if (b.ival() < 2 || b.ival() > 36 || mc.ival() > 32)
@@ -664,6 +1220,99 @@ void AddBuiltins()
     STARTDECL(rndseed) (Value &seed) { rnd.seed(seed.ival()); return Value(); } ENDDECL1(rndseed, "seed", "I", "",
         "explicitly set a random seed for reproducable randomness");
 
+    STARTDECL(rng_new) (Value &seed, Value &stream)
+    {
+        PCG32 pcg;
+        pcg.Seed((uint)seed.ival(), (uint)stream.ival());
+        auto v = (LVector *)g_vm->NewVector(0, 4, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_INT));
+        for (int i = 0; i < 4; i++) v->Push(Value(0));
+        Value rng(v);
+        RngState(rng).pcg = pcg;
+        return rng;
+    }
+    ENDDECL2(rng_new, "seed,stream", "II?", "I]",
+        "creates a random number generator (an independent PCG32), for use with the rng_ functions."
+        " generators with the same seed but a different stream produce unrelated sequences."
+        " copy the returned vector to get a generator that repeats the same sequence.");
+
+    STARTDECL(rng_int) (Value &rng, Value &range)
+    {
+        auto r = RngState(rng).pcg.Random();
+        rng.DECRT();
+        return Value(RngInt(r, max(1, range.ival())));
+    }
+    ENDDECL2(rng_int, "rng,max", "I]I", "I",
+        "a random value [0..max) from generator rng.");
+
+    STARTDECL(rng_float) (Value &rng)
+    {
+        auto r = RngState(rng).pcg.Random();
+        rng.DECRT();
+        return Value(RngFloat(r));
+    }
+    ENDDECL1(rng_float, "rng", "I]", "F",
+        "a random float [0..1) from generator rng.");
+
+    STARTDECL(rng_normal) (Value &rng)
+    {
+        float n1, n2;
+        {
+            RngState st(rng);
+            auto r1 = st.pcg.Random();
+            RngNormals(r1, st.pcg.Random(), n1, n2);
+        }
+        rng.DECRT();
+        return Value(n1);
+    }
+    ENDDECL1(rng_normal, "rng", "I]", "F",
+        "a random float from a normal distribution with mean 0 and standard deviation 1, from generator rng.");
+
+    STARTDECL(rng_ints) (Value &rng, Value &n, Value &range)
+    {
+        auto m = max(1, range.ival());
+        auto len = max(0, n.ival());
+        LVector *v;
+        {
+            RngState st(rng);
+            v = (LVector *)g_vm->NewVector(len, len, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_INT));
+            st.pcg.Generate(len, [&](size_t i, uint32_t r) { v->At((int)i) = Value(RngInt(r, m)); });
+        }
+        rng.DECRT();
+        return Value(v);
+    }
+    ENDDECL3(rng_ints, "rng,n,max", "I]II", "I]",
+        "n random values [0..max) from generator rng. same as calling rng_int n times, but faster.");
+
+    STARTDECL(rng_floats) (Value &rng, Value &n, Value &lo, Value &hi)
+    {
+        return RngFloats(rng, n.ival(), lo.fval(), hi.fval());
+    }
+    ENDDECL4(rng_floats, "rng,n,min,max", "I]IFF", "F]",
+        "n random floats [min..max) from generator rng. same as calling rng_float n times (and scaling), but"
+        " faster.");
+
+    STARTDECL(rng_floats) (Value &rng, Value &n)
+    {
+        return RngFloats(rng, n.ival(), 0, 1);
+    }
+    ENDDECL2(rng_floats, "rng,n", "I]I", "F]",
+        "n random floats [0..1) from generator rng. same as calling rng_float n times, but faster.");
+
+    STARTDECL(rng_normals) (Value &rng, Value &n, Value &mean, Value &deviation)
+    {
+        return RngNormalVector(rng, n.ival(), mean.fval(), deviation.fval());
+    }
+    ENDDECL4(rng_normals, "rng,n,mean,deviation", "I]IFF", "F]",
+        "n random floats from a normal distribution with the given mean and standard deviation, from"
+        " generator rng.");
+
+    STARTDECL(rng_normals) (Value &rng, Value &n)
+    {
+        return RngNormalVector(rng, n.ival(), 0, 1);
+    }
+    ENDDECL2(rng_normals, "rng,n", "I]I", "F]",
+        "n random floats from a normal distribution with mean 0 and standard deviation 1, from generator rng.");
+
     STARTDECL(div) (Value &a, Value &b) { return Value(float(a.ival()) / float(b.ival())); } ENDDECL2(div, "a,b", "II", "F",
         "forces two ints to be divided as floats");
 
@@ -708,6 +1357,25 @@ void AddBuiltins()
     ENDDECL3(inrange, "x,range,bias", "F]:2F]:2F]:2?", "I",
         "checks if a 2d float vector is >= bias and < bias + range. Bias defaults to 0.");
 
+    STARTDECL(astar_grid) (Value &costs, Value &width, Value &start, Value &end, Value &diagonal)
+    {
+        auto s = ValueDecToI<2>(start);
+        auto e = ValueDecToI<2>(end);
+        if (width.ival() <= 0 || costs.vval()->len % width.ival())
+        {
+            costs.DECRT();
+            g_vm->BuiltinError("astar_grid: costs length must be a multiple of width");
+        }
+        auto path = AStarGrid(costs.vval(), width.ival(), s, e, diagonal.ival() != 0);
+        costs.DECRT();
+        return Value(path);
+    }
+    ENDDECL5(astar_grid, "costs,width,start,end,diagonal", "I]II]:2I]:2I?", "I]",
+        "finds the cheapest path on a grid (stored row by row in costs, which holds the cost of entering each cell,"
+        " <= 0 being impassable) from start to end, optionally allowing diagonal moves (cost * sqrt(2))."
+        " returns the path from end to start inclusive as cell indices (x + y * width),"
+        " or an empty vector if there is no path. A native alternative to astar_2dgrid in astar.lobster.");
+
     STARTDECL(abs) (Value &a) { return Value(abs(a.ival())); } ENDDECL1(abs, "x", "I", "I",
         "absolute value of an integer");
     STARTDECL(abs) (Value &a) { return Value(fabsf(a.fval())); } ENDDECL1(abs, "x", "F", "F",
@@ -730,14 +1398,12 @@ void AddBuiltins()
         x.DECRT(); y.DECRT(); \
         return Value(v);
 
-    #define VECSCALAROP(type, init, fun) \
-        type v = init; \
-        for (int i = 0; i < x.eval()->Len(); i++) { \
-            auto f = x.eval()->At(i); \
-            fun; \
-        } \
+    #define VECMINMAX(T, R, largest, empty) \
+        ScalarElems<T> e(x); \
+        auto i = BulkMinIndex(e.p, e.len, largest); \
+        auto r = i < 0 ? empty : (R)e.p[i]; \
         x.DECRT(); \
-        return Value(v);
+        return Value(r);
 
     STARTDECL(min) (Value &x, Value &y) { return Value(min(x.ival(), y.ival())); } ENDDECL2(min, "x,y", "II", "I",
         "smallest of 2 integers.");
@@ -747,9 +1413,9 @@ void AddBuiltins()
         "smallest components of 2 int vectors");
     STARTDECL(min) (Value &x, Value &y) { VECBINOP(min,fval) } ENDDECL2(min, "x,y", "F]F]", "F]:/",
         "smallest components of 2 float vectors");
-    STARTDECL(min) (Value &x) { VECSCALAROP(int, INT_MAX, v = min(v, f.ival())) } ENDDECL1(min, "v", "I]", "I",
+    STARTDECL(min) (Value &x) { VECMINMAX(intp, int, false, INT_MAX) } ENDDECL1(min, "v", "I]", "I",
         "smallest component of a int vector. returns smallest possible int for empty vector");
-    STARTDECL(min) (Value &x) { VECSCALAROP(float, FLT_MAX, v = min(v, f.fval())) } ENDDECL1(min, "v", "F]", "F",
+    STARTDECL(min) (Value &x) { VECMINMAX(floatp, float, false, FLT_MAX) } ENDDECL1(min, "v", "F]", "F",
         "smallest component of a float vector. returns smallest possible float for empty vector");
 
     STARTDECL(max) (Value &x, Value &y) { return Value(max(x.ival(), y.ival())); } ENDDECL2(max, "x,y", "II", "I",
@@ -760,11 +1426,194 @@ void AddBuiltins()
         "largest components of 2 int vectors");
     STARTDECL(max) (Value &x, Value &y) { VECBINOP(max,fval) } ENDDECL2(max, "x,y", "F]F]", "F]:/",
         "largest components of 2 float vectors");
-    STARTDECL(max) (Value &x) { VECSCALAROP(int, INT_MIN, v = max(v, f.ival())) } ENDDECL1(max, "v", "I]", "I",
+    STARTDECL(max) (Value &x) { VECMINMAX(intp, int, true, INT_MIN) } ENDDECL1(max, "v", "I]", "I",
         "largest component of a int vector. returns largest possible int for empty vector");
-    STARTDECL(max) (Value &x) { VECSCALAROP(float, FLT_MIN, v = max(v, f.fval())) } ENDDECL1(max, "v", "F]", "F",
+    STARTDECL(max) (Value &x) { VECMINMAX(floatp, float, true, -FLT_MAX) } ENDDECL1(max, "v", "F]", "F",
         "largest component of a float vector. returns largest possible float for empty vector");
 
+    STARTDECL(min_index) (Value &x)
+    {
+        ScalarElems<intp> e(x);
+        auto r = BulkMinIndex(e.p, e.len, false);
+        x.DECRT();
+        return Value(r);
+    }
+    ENDDECL1(min_index, "v", "I]", "I",
+        "index of the smallest component of an int vector (the first, if several are equal), or -1 if empty");
+    STARTDECL(min_index) (Value &x)
+    {
+        ScalarElems<floatp> e(x);
+        auto r = BulkMinIndex(e.p, e.len, false);
+        x.DECRT();
+        return Value(r);
+    }
+    ENDDECL1(min_index, "v", "F]", "I",
+        "index of the smallest component of a float vector (the first, if several are equal), or -1 if empty");
+    STARTDECL(max_index) (Value &x)
+    {
+        ScalarElems<intp> e(x);
+        auto r = BulkMinIndex(e.p, e.len, true);
+        x.DECRT();
+        return Value(r);
+    }
+    ENDDECL1(max_index, "v", "I]", "I",
+        "index of the largest component of an int vector (the first, if several are equal), or -1 if empty");
+    STARTDECL(max_index) (Value &x)
+    {
+        ScalarElems<floatp> e(x);
+        auto r = BulkMinIndex(e.p, e.len, true);
+        x.DECRT();
+        return Value(r);
+    }
+    ENDDECL1(max_index, "v", "F]", "I",
+        "index of the largest component of a float vector (the first, if several are equal), or -1 if empty");
+
+    STARTDECL(sum) (Value &x)
+    {
+        ScalarElems<intp> e(x);
+        auto r = (int)BulkSum(e.p, e.len);
+        x.DECRT();
+        return Value(r);
+    }
+    ENDDECL1(sum, "xs", "I]", "I",
+        "sum of all elements of an int vector");
+    STARTDECL(sum) (Value &x)
+    {
+        ScalarElems<floatp> e(x);
+        auto r = (float)BulkSum(e.p, e.len);
+        x.DECRT();
+        return Value(r);
+    }
+    ENDDECL1(sum, "xs", "F]", "F",
+        "sum of all elements of a float vector");
+
+    STARTDECL(product) (Value &x)
+    {
+        ScalarElems<intp> e(x);
+        intp r = 1;
+        for (int i = 0; i < e.len; i++) r *= e.p[i];
+        x.DECRT();
+        return Value((int)r);
+    }
+    ENDDECL1(product, "xs", "I]", "I",
+        "product of all elements of an int vector");
+    STARTDECL(product) (Value &x)
+    {
+        ScalarElems<floatp> e(x);
+        floatp r = 1;
+        for (int i = 0; i < e.len; i++) r *= e.p[i];
+        x.DECRT();
+        return Value((float)r);
+    }
+    ENDDECL1(product, "xs", "F]", "F",
+        "product of all elements of a float vector");
+
+    STARTDECL(mean) (Value &x)
+    {
+        ScalarElems<floatp> e(x);
+        auto r = e.len ? float(BulkSum(e.p, e.len) / e.len) : 0.0f;
+        x.DECRT();
+        return Value(r);
+    }
+    ENDDECL1(mean, "xs", "F]", "F",
+        "average of all elements of a float vector, or 0 if empty");
+    STARTDECL(mean) (Value &x)
+    {
+        ScalarElems<intp> e(x);
+        auto r = e.len ? float(double(BulkSum(e.p, e.len)) / e.len) : 0.0f;
+        x.DECRT();
+        return Value(r);
+    }
+    ENDDECL1(mean, "xs", "I]", "F",
+        "average of all elements of an int vector, or 0 if empty");
+
+    STARTDECL(inner_product) (Value &x, Value &y)
+    {
+        ScalarElems<floatp> a(x), b(y);
+        if (a.len != b.len) { x.DECRT(); y.DECRT(); g_vm->BuiltinError("inner_product: vectors must be equal length"); }
+        auto r = BulkDot(a.p, b.p, a.len);
+        x.DECRT();
+        y.DECRT();
+        return Value((float)r);
+    }
+    ENDDECL2(inner_product, "xs,ys", "F]F]", "F",
+        "sum of the products of the elements of 2 float vectors of equal length, i.e. a dot product of any length"
+        " (dot() uses at most 4 components)");
+
+    STARTDECL(multiply_add) (Value &f, Value &x, Value &y)
+    {
+        ScalarElems<floatp> a(x), b(y);
+        if (a.len != b.len) { x.DECRT(); y.DECRT(); g_vm->BuiltinError("multiply_add: vectors must be equal length"); }
+        auto v = (LVector *)g_vm->NewVector(a.len, a.len, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_FLOAT));
+        auto m = f.fval();
+        for (int i = 0; i < a.len; i++) v->At(i) = Value(float(m * a.p[i] + b.p[i]));
+        x.DECRT();
+        y.DECRT();
+        return Value(v);
+    }
+    ENDDECL3(multiply_add, "f,xs,ys", "FF]F]", "F]",
+        "returns f * xs + ys for float vectors of equal length in one pass, without the intermediate vector.");
+
+    STARTDECL(prefix_sum) (Value &x)
+    {
+        ScalarElems<intp> e(x);
+        auto v = (LVector *)g_vm->NewVector(e.len, e.len, x.eval()->ti);
+        intp s = 0;
+        for (int i = 0; i < e.len; i++) v->At(i) = Value((int)(s += e.p[i]));
+        x.DECRT();
+        return Value(v);
+    }
+    ENDDECL1(prefix_sum, "xs", "I]", "I]",
+        "returns a vector where each element is the sum of all elements of xs up to and including that index");
+    STARTDECL(prefix_sum) (Value &x)
+    {
+        ScalarElems<floatp> e(x);
+        auto v = (LVector *)g_vm->NewVector(e.len, e.len, x.eval()->ti);
+        floatp s = 0;
+        for (int i = 0; i < e.len; i++) v->At(i) = Value((float)(s += e.p[i]));
+        x.DECRT();
+        return Value(v);
+    }
+    ENDDECL1(prefix_sum, "xs", "F]", "F]",
+        "returns a vector where each element is the sum of all elements of xs up to and including that index");
+
+    STARTDECL(histogram) (Value &x, Value &bins, Value &lo, Value &hi)
+    {
+        auto n = bins.ival();
+        if (n <= 0) { x.DECRT(); g_vm->BuiltinError("histogram: number of bins must be positive"); }
+        ScalarElems<floatp> e(x);
+        vector<int> counts(n, 0);
+        floatp l = lo.fval(), scale = n / (floatp(hi.fval()) - l);
+        for (int i = 0; i < e.len; i++)
+        {
+            auto b = (e.p[i] - l) * scale;
+            // Written as a negated comparison so NaN falls outside too.
+            if (!(b >= 0 && b < n)) continue;
+            counts[(int)b]++;
+        }
+        x.DECRT();
+        auto v = (LVector *)g_vm->NewVector(n, n, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_INT));
+        for (int i = 0; i < n; i++) v->At(i) = Value(counts[i]);
+        return Value(v);
+    }
+    ENDDECL4(histogram, "xs,bins,min,max", "F]IFF", "I]",
+        "counts how many elements of xs fall in each of bins equal sized ranges between min and max. elements"
+        " outside [min..max) are not counted.");
+    STARTDECL(histogram) (Value &x, Value &bins)
+    {
+        auto n = bins.ival();
+        if (n <= 0) { x.DECRT(); g_vm->BuiltinError("histogram: number of bins must be positive"); }
+        ScalarElems<intp> e(x);
+        vector<int> counts(n, 0);
+        for (int i = 0; i < e.len; i++) if (e.p[i] >= 0 && e.p[i] < n) counts[(int)e.p[i]]++;
+        x.DECRT();
+        auto v = (LVector *)g_vm->NewVector(n, n, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_INT));
+        for (int i = 0; i < n; i++) v->At(i) = Value(counts[i]);
+        return Value(v);
+    }
+    ENDDECL2(histogram, "xs,bins", "I]I", "I]",
+        "counts how often each of the values 0 .. bins - 1 occurs in xs, other values are not counted.");
+
     STARTDECL(cardinalspline) (Value &z, Value &a, Value &b, Value &c, Value &f, Value &t)
     {
         return ToValueF(cardinalspline(ValueDecToF<3>(z),
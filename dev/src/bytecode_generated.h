@@ -78,12 +78,16 @@ struct Struct FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   const flatbuffers::String *name() const { return GetPointer<const flatbuffers::String *>(4); }
   int32_t idx() const { return GetField<int32_t>(6, 0); }
   int32_t nfields() const { return GetField<int32_t>(8, 0); }
+  const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>> *fieldnames() const { return GetPointer<const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>> *>(10); }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyField<flatbuffers::uoffset_t>(verifier, 4 /* name */) &&
            verifier.Verify(name()) &&
            VerifyField<int32_t>(verifier, 6 /* idx */) &&
            VerifyField<int32_t>(verifier, 8 /* nfields */) &&
+           VerifyField<flatbuffers::uoffset_t>(verifier, 10 /* fieldnames */) &&
+           verifier.Verify(fieldnames()) &&
+           verifier.VerifyVectorOfStrings(fieldnames()) &&
            verifier.EndTable();
   }
 };
@@ -94,10 +98,11 @@ struct StructBuilder {
   void add_name(flatbuffers::Offset<flatbuffers::String> name) { fbb_.AddOffset(4, name); }
   void add_idx(int32_t idx) { fbb_.AddElement<int32_t>(6, idx, 0); }
   void add_nfields(int32_t nfields) { fbb_.AddElement<int32_t>(8, nfields, 0); }
+  void add_fieldnames(flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>> fieldnames) { fbb_.AddOffset(10, fieldnames); }
   StructBuilder(flatbuffers::FlatBufferBuilder &_fbb) : fbb_(_fbb) { start_ = fbb_.StartTable(); }
   StructBuilder &operator=(const StructBuilder &);
   flatbuffers::Offset<Struct> Finish() {
-    auto o = flatbuffers::Offset<Struct>(fbb_.EndTable(start_, 3));
+    auto o = flatbuffers::Offset<Struct>(fbb_.EndTable(start_, 4));
     return o;
   }
 };
@@ -105,8 +110,10 @@ struct StructBuilder {
 inline flatbuffers::Offset<Struct> CreateStruct(flatbuffers::FlatBufferBuilder &_fbb,
    flatbuffers::Offset<flatbuffers::String> name = 0,
    int32_t idx = 0,
-   int32_t nfields = 0) {
+   int32_t nfields = 0,
+   flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>> fieldnames = 0) {
   StructBuilder builder_(_fbb);
+  builder_.add_fieldnames(fieldnames);
   builder_.add_nfields(nfields);
   builder_.add_idx(idx);
   builder_.add_name(name);
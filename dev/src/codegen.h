@@ -30,6 +30,8 @@ struct CodeGen
 
     vector<TypeRef> rettypes, temptypestack;
 
+    int merged_specializations, merged_code;
+
     int Pos() { return (int)code.size(); }
 
     void Emit(int i)
@@ -124,7 +126,7 @@ struct CodeGen
         return offset;
     }
 
-    CodeGen(Parser &_p, SymbolTable &_st) : parser(_p), st(_st)
+    CodeGen(Parser &_p, SymbolTable &_st) : parser(_p), st(_st), merged_specializations(0), merged_code(0)
     {
         // Pre-load some types into the table, must correspond to order of type_elem_t enums.
                                                     GetTypeTableOffset(type_int);
@@ -181,6 +183,10 @@ struct CodeGen
             assert(!code[fixup.first]);
             code[fixup.first] = bytecodestart;
         }
+
+        MergeSpecializations();
+        Output(OUTPUT_INFO, "codegen: merged %d identical specializations, saving %d of %d code words",
+               merged_specializations, merged_code, Pos() + merged_code);
     }
 
     ~CodeGen()
@@ -345,6 +351,309 @@ struct CodeGen
         linenumbernodes.pop_back();
     }
 
+    enum OperandKind { OPK_VAL, OPK_ADDR, OPK_SID, OPK_LOCALSID };
+
+    // Calls f(pos, kind) for every operand of the instruction at pos, returns the position of the next one.
+    template<typename F> int ForEachOperand(int pos, F f)
+    {
+        auto opc = code[pos++];
+        auto op = [&](OperandKind k) { f(pos, k); pos++; };
+        switch (opc)
+        {
+            case IL_PUSHFUN:
+            case IL_JUMP:
+            case IL_JUMPFAIL:
+            case IL_JUMPFAILR:
+            case IL_JUMPFAILN:
+            case IL_JUMPNOFAIL:
+            case IL_JUMPNOFAILR:
+            case IL_JUMPFAILREF:
+            case IL_JUMPFAILRREF:
+            case IL_JUMPFAILNREF:
+            case IL_JUMPNOFAILREF:
+            case IL_JUMPNOFAILRREF:
+                op(OPK_ADDR);
+                break;
+
+            case IL_PUSHINT:
+            case IL_PUSHFLT:
+            case IL_PUSHFLD:
+            case IL_PUSHFLDM:
+            case IL_PUSHLOC:
+            case IL_LVALIDXI:
+            case IL_LVALIDXV:
+            case IL_BCALL:
+            case IL_CONT1:
+            case IL_CONT1REF:
+            case IL_IFOR:
+            case IL_IFORREF:
+            case IL_SFOR:
+            case IL_SFORREF:
+            case IL_VFOR:
+            case IL_VFORREF:
+            case IL_ISTYPE:
+            case IL_EXIT:
+            case IL_LOGREAD:
+            case IL_LOGREADREF:
+                op(OPK_VAL);
+                break;
+
+            case IL_CALLV:
+            case IL_CALLVCOND:
+            case IL_NEWVEC:
+            case IL_LVALFLD:
+            case IL_LVALLOC:
+                op(OPK_VAL); op(OPK_VAL);
+                break;
+
+            case IL_RETURN:
+                op(OPK_VAL); op(OPK_VAL); op(OPK_VAL);
+                break;
+
+            case IL_PUSHVAR:
+            case IL_PUSHVARREF:
+                op(OPK_SID);
+                break;
+
+            case IL_LVALVAR:
+                op(OPK_VAL); op(OPK_SID);
+                break;
+
+            case IL_CALL:
+            case IL_CALLMULTI:
+            {
+                auto nargs = code[pos];
+                op(OPK_VAL); op(OPK_VAL); op(OPK_ADDR); op(OPK_VAL);
+                if (opc == IL_CALLMULTI) for (int i = 0; i < nargs; i++) op(OPK_VAL);
+                break;
+            }
+
+            case IL_PUSHSTR:
+                while (code[pos]) op(OPK_VAL);
+                op(OPK_VAL);
+                break;
+
+            case IL_FUNSTART:
+                for (int j = 0; j < 2; j++)  // Args, then locals.
+                {
+                    auto n = code[pos];
+                    op(OPK_VAL);
+                    for (int i = 0; i < n; i++) op(OPK_LOCALSID);
+                }
+                op(OPK_VAL);
+                break;
+
+            case IL_FUNMULTI:
+            {
+                auto n = code[pos];
+                op(OPK_VAL);
+                auto nargs = code[pos];
+                op(OPK_VAL);
+                for (int i = 0; i < n; i++)
+                {
+                    for (int j = 0; j < nargs; j++) op(OPK_VAL);
+                    op(OPK_ADDR);
+                }
+                break;
+            }
+
+            case IL_CORO:
+            {
+                op(OPK_ADDR); op(OPK_VAL);
+                auto n = code[pos];
+                op(OPK_VAL);
+                for (int i = 0; i < n; i++) op(OPK_SID);
+                break;
+            }
+        }
+        return pos;
+    }
+
+    // Specializations frequently generate the same code, e.g. when they only differ in the type of a reference
+    // argument. Since blocks are functions too, their specializations refer to each other's variables and
+    // call each other, so finds the largest set of specializations that are equal modulo those references (by
+    // partition refinement), keeps one of each, and redirects all calls and variable references to it.
+    void MergeSpecializations()
+    {
+        struct Spec { SubFunction *sf; int start, end; };
+        vector<Spec> specs;
+        map<int, int> spec_at;  // Code start -> spec.
+        for (auto f : st.functiontable) if (!f->multimethod && f->bytecodestart > 0)
+        {
+            for (auto sf = f->subf; sf; sf = sf->next)
+            {
+                // Coroutine types refer to their SubFunction directly.
+                if (sf->subbytecodestart <= 0 || sf->iscoroutine) continue;
+                Spec spec = { sf, sf->subbytecodestart, sf->subbytecodestart };
+                while (code[spec.end] != IL_FUNEND) spec.end = ForEachOperand(spec.end, [](int, OperandKind) {});
+                spec.end++;
+                spec_at[spec.start] = (int)specs.size();
+                specs.push_back(spec);
+            }
+        }
+
+        map<int, pair<int, int>> localof;  // Sid -> spec & index among its args and locals.
+        vector<vector<int>> locals(specs.size());
+        for (size_t i = 0; i < specs.size(); i++)
+        {
+            ForEachOperand(specs[i].start, [&](int pos, OperandKind k)
+            {
+                if (k != OPK_LOCALSID) return;
+                localof[code[pos]] = make_pair((int)i, (int)locals[i].size());
+                locals[i].push_back(code[pos]);
+            });
+        }
+
+        // Start out assuming all specializations of the same function with the same code size are equal, then split
+        // up classes until stable.
+        vector<int> cls(specs.size());
+        size_t numclasses = 0;
+        for (;;)
+        {
+            map<vector<int>, int> classes;
+            vector<int> key;
+            for (size_t i = 0; i < specs.size(); i++)
+            {
+                auto &spec = specs[i];
+                key.clear();
+                key.push_back(numclasses ? cls[i] : spec.sf->parent->idx);
+                key.push_back(spec.end - spec.start);
+                if (numclasses) for (auto pos = spec.start; pos < spec.end; )
+                {
+                    key.push_back(code[pos]);
+                    pos = ForEachOperand(pos, [&](int opos, OperandKind k)
+                    {
+                        auto x = code[opos];
+                        switch (k)
+                        {
+                            case OPK_VAL:
+                                key.push_back(0); key.push_back(x);
+                                break;
+                            case OPK_ADDR:
+                            {
+                                auto it = spec_at.find(x);
+                                if (x >= spec.start && x < spec.end) { key.push_back(1); key.push_back(x - spec.start); }
+                                else if (it != spec_at.end())        { key.push_back(2); key.push_back(cls[it->second]); }
+                                else                                 { key.push_back(3); key.push_back(x); }
+                                break;
+                            }
+                            case OPK_SID:
+                            {
+                                auto it = localof.find(x);
+                                if (it != localof.end())
+                                {
+                                    key.push_back(4); key.push_back(cls[it->second.first]); key.push_back(it->second.second);
+                                }
+                                else { key.push_back(5); key.push_back(x); }
+                                break;
+                            }
+                            case OPK_LOCALSID:
+                                // The VM only cares about the runtime type of variables, e.g. for refcounting.
+                                key.push_back(6); key.push_back(type_table[sids[x].typeidx()]);
+                                break;
+                        }
+                    });
+                }
+                auto it = classes.find(key);
+                if (it == classes.end()) it = classes.insert(make_pair(key, (int)classes.size())).first;
+                cls[i] = it->second;
+            }
+            // Each round only ever splits classes (the old class is part of the key), so this terminates.
+            bool stable = classes.size() == numclasses;
+            numclasses = classes.size();
+            if (stable) break;
+        }
+
+        // Keep the first of each class.
+        vector<int> rep(numclasses, -1);
+        map<int, int> redirect;         // Code start of a dropped specialization -> that of its replacement.
+        map<int, int> sidremap;
+        vector<pair<int, int>> removed;  // Code ranges, in order.
+        for (size_t i = 0; i < specs.size(); i++)
+        {
+            auto &r = rep[cls[i]];
+            if (r < 0) { r = (int)i; continue; }
+            redirect[specs[i].start] = specs[r].start;
+            for (size_t j = 0; j < locals[i].size(); j++) sidremap[locals[i][j]] = locals[r][j];
+            removed.push_back(make_pair(specs[i].start, specs[i].end));
+            merged_specializations++;
+            merged_code += specs[i].end - specs[i].start;
+        }
+        if (removed.empty()) return;
+        sort(removed.begin(), removed.end());
+        vector<int> removedbefore(1, 0);
+        for (auto &r : removed) removedbefore.push_back(removedbefore.back() + r.second - r.first);
+
+        auto newpos = [&](int pos)
+        {
+            auto it = upper_bound(removed.begin(), removed.end(), make_pair(pos, INT_MAX));
+            if (it == removed.begin()) return pos;
+            auto i = it - removed.begin() - 1;
+            return pos - removedbefore[i] - min(pos - removed[i].first, removed[i].second - removed[i].first);
+        };
+
+        vector<int> ncode;
+        auto r = removed.begin();
+        for (int pos = 0; pos < Pos(); )
+        {
+            if (r != removed.end() && pos == r->first) { pos = r->second; ++r; continue; }
+            auto start = ncode.size();
+            auto next = ForEachOperand(pos, [](int, OperandKind) {});
+            ncode.insert(ncode.end(), code.begin() + pos, code.begin() + next);
+            ForEachOperand(pos, [&](int opos, OperandKind k)
+            {
+                auto &x = ncode[start + opos - pos];
+                if (k == OPK_ADDR)
+                {
+                    auto it = redirect.find(x);
+                    x = newpos(it != redirect.end() ? it->second : x);
+                }
+                else if (k == OPK_SID)
+                {
+                    auto it = sidremap.find(x);
+                    if (it != sidremap.end()) x = it->second;
+                }
+            });
+            pos = next;
+        }
+
+        // Line info of dropped code goes, but if the code after it relied on that line, it needs a new entry.
+        vector<bytecode::LineInfo> nlineinfo;
+        auto addline = [&](const bytecode::LineInfo &li, int pos)
+        {
+            if (!nlineinfo.empty() && nlineinfo.back().bytecodestart() == pos) nlineinfo.pop_back();
+            nlineinfo.push_back(bytecode::LineInfo(li.line(), li.fileidx(), pos));
+        };
+        const bytecode::LineInfo *pending = nullptr;
+        int pendingend = 0;
+        for (auto &li : lineinfo)
+        {
+            auto it = upper_bound(removed.begin(), removed.end(), make_pair(li.bytecodestart(), INT_MAX));
+            if (it != removed.begin() && li.bytecodestart() < (it - 1)->second)
+            {
+                pending = &li;
+                pendingend = (it - 1)->second;
+                continue;
+            }
+            if (pending && li.bytecodestart() > pendingend) addline(*pending, newpos(pendingend));
+            pending = nullptr;
+            addline(li, newpos(li.bytecodestart()));
+        }
+        if (pending && pendingend < Pos()) addline(*pending, newpos(pendingend));
+
+        for (auto f : st.functiontable)
+        {
+            if (f->bytecodestart > 0) f->bytecodestart = newpos(f->bytecodestart);
+            for (auto sf = f->subf; sf; sf = sf->next) if (sf->subbytecodestart > 0)
+            {
+                auto it = redirect.find(sf->subbytecodestart);
+                sf->subbytecodestart = newpos(it != redirect.end() ? it->second : sf->subbytecodestart);
+            }
+        }
+        code.swap(ncode);
+        lineinfo.swap(nlineinfo);
+    }
+
     void EmitTempInfo(const Node *callnode)
     {
         int i = 0;
@@ -362,6 +671,33 @@ struct CodeGen
         Emit((int)mask);
     }
 
+    // Scalar overloads of common math builtins get their own opcode, avoiding the generic IL_BCALL dispatch.
+    int MathOpcode(const NativeFun *nf)
+    {
+        if (nf->ncm != NCM_NONE) return -1;
+        for (auto &arg : nf->args.v) if (arg.type->t != V_INT && arg.type->t != V_FLOAT) return -1;
+        auto isint = nf->args.v.size() && nf->args.v[0].type->t == V_INT;
+        auto &name = nf->name;
+        switch (nf->args.v.size())
+        {
+            case 1:
+                if (name == "sqrt") return IL_FSQRT;
+                if (name == "sin")  return IL_FSIN;
+                if (name == "cos")  return IL_FCOS;
+                if (name == "abs")  return isint ? IL_IABS : IL_FABS;
+                break;
+            case 2:
+                if (name == "min")  return isint ? IL_IMIN : IL_FMIN;
+                if (name == "max")  return isint ? IL_IMAX : IL_FMAX;
+                break;
+            case 3:
+                if (name == "clamp") return isint ? IL_ICLAMP : IL_FCLAMP;
+                if (name == "lerp")  return IL_FLERP;
+                break;
+        }
+        return -1;
+    }
+
     void TakeTemp(int n) { temptypestack.erase(temptypestack.end() - n, temptypestack.end()); }
 
     void GenFixup(const SubFunction *sf)
@@ -499,11 +835,22 @@ struct CodeGen
             }
 
             case T_ASSIGN:
+            {
+                vector<const Node *> pieces;
+                if (StringAppends(n, pieces))
+                {
+                    // s = s + x + y is the same as s += x; s += y, which can append in place.
+                    for (size_t i = 0; i < pieces.size(); i++)
+                        GenAssign(n->left(), LVO_IADD, i + 1 == pieces.size() ? retval : 0, n->left()->exptype,
+                                  pieces[i]);
+                    break;
+                }
                 GenAssign(n->left(),
                           IsRefNil(n->left()->exptype->t) ? LVO_WRITEREF : LVO_WRITE, retval,
                           nullptr,
                           n->right());
                 break;
+            }
 
             case T_PLUSEQ:  GenAssign(n->left(), LVO_IADD, retval, n->exptype, n->right()); break;
             case T_MINUSEQ: GenAssign(n->left(), LVO_ISUB, retval, n->exptype, n->right()); break;
@@ -690,6 +1037,10 @@ struct CodeGen
                             Emit(IsRefNil(lastarg->exptype->sf->returntypes[0]->t) ? IL_CONT1REF : IL_CONT1, nf->idx);
                         }
                     }
+                    else if (MathOpcode(nf) >= 0)
+                    {
+                        Emit(MathOpcode(nf));
+                    }
                     else
                     {
                         Emit(IL_BCALL, nf->idx);
@@ -1026,6 +1377,30 @@ struct CodeGen
         linenumbernodes.pop_back();
     }
 
+    // Whether evaluating n reads variable sid, or may run script code that could modify it.
+    bool DependsOn(const Node *n, const SpecIdent *sid)
+    {
+        if (!n) return false;
+        if (n->type == T_IDENT) return n->sid() == sid;
+        if (n->type == T_CALL || n->type == T_DYNCALL) return true;
+        if (n->type == T_NATCALL && n->ncall_id()->nf()->ncm != NCM_NONE) return true;
+        return DependsOn(n->a(), sid) || DependsOn(n->b(), sid) || DependsOn(n->c(), sid);
+    }
+
+    // s = s + x + y.., where none of x, y.. depend on s: collects x, y..
+    bool StringAppends(const Node *n, vector<const Node *> &pieces)
+    {
+        auto lval = n->left();
+        if (lval->type != T_IDENT || lval->exptype->t != V_STRING) return false;
+        auto rhs = n->right();
+        for (; rhs->type == T_PLUS && rhs->exptype->t == V_STRING; rhs = rhs->left())
+        {
+            if (DependsOn(rhs->right(), lval->sid())) return false;
+            pieces.insert(pieces.begin(), rhs->right());
+        }
+        return pieces.size() && rhs->type == T_IDENT && rhs->sid() == lval->sid();
+    }
+
     void GenAssign(const Node *lval, int lvalop, int retval, TypeRef type, const Node *rhs = nullptr)
     {
         if (lvalop >= LVO_IADD && lvalop <= LVO_IMOD)
@@ -58,28 +58,126 @@ const Type g_type_typeid(V_TYPEID);                     TypeRef type_typeid = &g
 const Type g_type_function_nil(V_NIL,
                                 &*type_function_null);  TypeRef type_function_nil = &g_type_function_nil;
 
-void Compile(const char *fn, char *stringsource, vector<uchar> &bytecode, string *parsedump = nullptr)
+// Collects per-pass cost for --time-passes.
+struct PassTimes
 {
+    string *report;
+    double start;
+
+    PassTimes(string *_report) : report(_report), start(SecondsSinceStart())
+    {
+        if (report) *report = "pass         time (ms)  peak pool (KB)     nodes  subfunctions  bytecode (bytes)";
+    }
+
+    void Pass(const char *name, Parser &parser, SymbolTable &st, size_t bytecodesize = 0)
+    {
+        if (!report) return;
+        auto now = SecondsSinceStart();
+        // Function bodies are not part of the main tree, and deleted SubFunctions are still in subfunctiontable,
+        // so walk them thru their Function.
+        int nodes = CountNodes(parser.root);
+        int numsf = 0;
+        for (auto f : st.functiontable) for (auto sf = f->subf; sf; sf = sf->next)
+        {
+            nodes += CountNodes(sf->body);
+            numsf++;
+        }
+        char buf[256];
+        snprintf(buf, sizeof(buf), "\n%-10s %11.2f %15lu %9d %13d", name, (now - start) * 1000,
+                 (unsigned long)(parserpool->peak_memory_usage() / 1024), nodes, numsf);
+        *report += buf;
+        if (bytecodesize)
+        {
+            snprintf(buf, sizeof(buf), " %17lu", (unsigned long)bytecodesize);
+            *report += buf;
+        }
+        start = now;
+    }
+
+    void Total(double compilestart)
+    {
+        if (!report) return;
+        char buf[64];
+        snprintf(buf, sizeof(buf), "\n%-10s %11.2f", "total", (SecondsSinceStart() - compilestart) * 1000);
+        *report += buf;
+    }
+};
+
+void Compile(const char *fn, char *stringsource, vector<uchar> &bytecode, string *parsedump = nullptr,
+             vector<string> *filenames = nullptr, string *passreport = nullptr)
+{
+    PassTimes times(passreport);
+    auto compilestart = times.start;
+
     SymbolTable st;
 
     Parser parser(fn, st, stringsource);
     parser.Parse();
+    times.Pass("parse", parser, st);
 
     TypeChecker tc(parser, st);
+    times.Pass("typecheck", parser, st);
     
     // Optimizer is not optional, must always run at least one pass, since TypeChecker and CodeGen rely
     // on it culling const if-thens and other things.
     Optimizer opt(parser, st, tc, 100);
+    times.Pass("optimize", parser, st);
 
     if (parsedump) *parsedump = parser.DumpAll();
 
     CodeGen cg(parser, st);
+    times.Pass("codegen", parser, st, cg.code.size() * sizeof(int));
 
     st.Serialize(cg.code, cg.type_table, cg.vint_typeoffsets, cg.vfloat_typeoffsets, cg.lineinfo, cg.sids, bytecode);
+    times.Pass("serialize", parser, st, bytecode.size());
+    times.Total(compilestart);
+
+    if (filenames) *filenames = st.filenames;
 
     //parserpool->printstats();
 }
 
+bool SourceHash(const vector<string> &filenames, uint64_t &hash)
+{
+    // Anything that can change the bytecode for identical source: the compiler build, and the builtin
+    // table (bytecode refers to builtins by index, and was type checked against their signatures, which may
+    // change in builtins.cpp without this file being recompiled).
+    static const char version[] = __DATE__ " " __TIME__;
+    hash = FNV1A64(version, sizeof(version));
+    hash = FNV1A64(&LOBSTER_BYTECODE_FORMAT_VERSION, sizeof(int), hash);
+    auto hashargs = [&](const NargVector &nv)
+    {
+        auto n = (int)nv.v.size();
+        hash = FNV1A64(&n, sizeof(int), hash);
+        if (nv.idlist) hash = FNV1A64(nv.idlist, strlen(nv.idlist) + 1, hash);
+        for (auto &a : nv.v)
+        {
+            auto tn = TypeName(a.type);
+            int bits[] = { a.flags, a.fixed_len };
+            hash = FNV1A64(tn.c_str(), tn.length() + 1, hash);
+            hash = FNV1A64(bits, sizeof(bits), hash);
+        }
+    };
+    for (auto nf : natreg.nfuns)
+    {
+        hash = FNV1A64(nf->name.c_str(), nf->name.length() + 1, hash);
+        hashargs(nf->args);
+        hashargs(nf->retvals);
+        int ncm = nf->ncm;
+        hash = FNV1A64(&ncm, sizeof(int), hash);
+    }
+    for (auto &fn : filenames)
+    {
+        size_t len = 0;
+        auto source = LoadedFile::LoadSource(fn.c_str(), &len);
+        if (!source) return false;
+        hash = FNV1A64(fn.c_str(), fn.length() + 1, hash);
+        hash = FNV1A64(source, len, hash);
+        free(source);
+    }
+    return true;
+}
+
 bool VerifyBytecode(const vector<uchar> &bytecode)
 {
     flatbuffers::Verifier verifier(bytecode.data(), bytecode.size());
@@ -15,7 +15,9 @@
 namespace lobster
 {
 
-extern void Compile(const char *fn, char *stringsource, vector<uchar> &bytecode, string *parsedump = nullptr);
+extern void Compile(const char *fn, char *stringsource, vector<uchar> &bytecode, string *parsedump = nullptr,
+                    vector<string> *filenames = nullptr, string *passreport = nullptr);
+extern bool SourceHash(const vector<string> &filenames, uint64_t &hash);
 extern bool VerifyBytecode(const vector<uchar> &bytecode);
 extern void RegisterBuiltins();
 extern void DumpBuiltins(bool justnames);
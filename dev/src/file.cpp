@@ -31,6 +31,8 @@
     #include <sys/types.h>
     #include <sys/stat.h>
     #include <unistd.h>
+    #include <dirent.h>
+    #include <fcntl.h>
 #endif
 
 using namespace lobster;
@@ -46,6 +48,155 @@ void AddDirItem(LVector *nlist, LVector *slist, const char *filename, int64_t si
     slist->Push(Value(int(size)));
 }
 
+// Matches a file name against a pattern with * and ? wildcards.
+static bool GlobMatch(const char *pat, const char *s)
+{
+    const char *star = nullptr, *retry = s;
+    while (*s)
+    {
+        if (*pat == '?' || *pat == *s) { pat++; s++; }
+        else if (*pat == '*')          { star = pat++; retry = s; }
+        else if (star)                 { pat = star + 1; s = ++retry; }
+        else return false;
+    }
+    while (*pat == '*') pat++;
+    return !*pat;
+}
+
+struct TreeScan
+{
+    string root;
+    const char *filter;
+    LVector *names, *sizes, *mtimes;
+
+    void AddFile(const string &path, const char *name, int64_t size, int64_t mtime)
+    {
+        if (filter && !GlobMatch(filter, name)) return;
+        names->Push(Value(g_vm->NewString(path)));
+        sizes->Push(Value((int)min(size, (int64_t)0x7FFFFFFF)));
+        mtimes->Push(Value((int)min(mtime, (int64_t)0x7FFFFFFF)));
+    }
+
+    // rel is relative to root, and ends in a separator unless empty.
+    void Scan(const string &rel)
+    {
+        vector<string> subdirs;
+
+        #ifdef _WIN32
+
+            WIN32_FIND_DATA fdata;
+            HANDLE fh = FindFirstFile((root + rel + "*.*").c_str(), &fdata);
+            if (fh == INVALID_HANDLE_VALUE) return;
+            do
+            {
+                if (!strcmp(fdata.cFileName, ".") || !strcmp(fdata.cFileName, "..")) continue;
+                if (fdata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                {
+                    subdirs.push_back(rel + fdata.cFileName + "/");
+                }
+                else
+                {
+                    int64_t size = (int64_t(fdata.nFileSizeHigh) << 32) | fdata.nFileSizeLow;
+                    int64_t ft = (int64_t(fdata.ftLastWriteTime.dwHighDateTime) << 32) |
+                                 fdata.ftLastWriteTime.dwLowDateTime;
+                    AddFile(rel + fdata.cFileName, fdata.cFileName, size,
+                            (ft - 116444736000000000LL) / 10000000);  // FILETIME to unix time.
+                }
+            }
+            while (FindNextFile(fh, &fdata));
+            FindClose(fh);
+
+        #else
+
+            DIR *dir = opendir((root + rel).c_str());
+            if (!dir) return;
+            while (auto e = readdir(dir))
+            {
+                if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+                // d_type saves a stat for directories and files the filter rejects. Symlinked folders are not
+                // followed, so there's no risk of cycles.
+                if (e->d_type == DT_DIR)
+                {
+                    subdirs.push_back(rel + e->d_name + "/");
+                    continue;
+                }
+                if (e->d_type != DT_UNKNOWN && e->d_type != DT_REG && e->d_type != DT_LNK) continue;
+                if (filter && !GlobMatch(filter, e->d_name)) continue;
+                struct stat st;
+                if (fstatat(dirfd(dir), e->d_name, &st, 0)) continue;
+                if (S_ISDIR(st.st_mode))
+                {
+                    if (e->d_type == DT_UNKNOWN) subdirs.push_back(rel + e->d_name + "/");
+                }
+                else if (S_ISREG(st.st_mode))
+                {
+                    AddFile(rel + e->d_name, e->d_name, st.st_size, st.st_mtime);
+                }
+            }
+            closedir(dir);
+
+        #endif
+
+        // Recurse after closing this folder, to not hold on to a handle per level.
+        for (auto &sd : subdirs) Scan(sd);
+    }
+};
+
+static bool SeekFile(FILE *f, int64_t offset, int origin)
+{
+    #ifdef _WIN32
+        return !_fseeki64(f, offset, origin);
+    #else
+        return !fseeko(f, (off_t)offset, origin);
+    #endif
+}
+
+static int64_t TellFile(FILE *f)
+{
+    #ifdef _WIN32
+        return _ftelli64(f);
+    #else
+        return (int64_t)ftello(f);
+    #endif
+}
+
+// Reads up to len bytes (or the rest of the file if len < 0) from offset straight into a new string, avoiding an
+// intermediate buffer, which matters for big files.
+static LString *ReadIntoString(FILE *f, int64_t offset, int64_t len)
+{
+    if (!SeekFile(f, 0, SEEK_END)) return nullptr;
+    auto size = TellFile(f);
+    if (size < 0) return nullptr;
+    offset = min(max(offset, (int64_t)0), size);
+    if (len < 0 || len > size - offset) len = size - offset;
+    if (len > INT_MAX || !SeekFile(f, offset, SEEK_SET)) return nullptr;
+    auto s = g_vm->NewString((size_t)len);
+    if (len && fread(s->str(), (size_t)len, 1, f) != 1)
+    {
+        Value(s).DECRT();
+        return nullptr;
+    }
+    s->str()[len] = 0;
+    return s;
+}
+
+// Files opened with open_file / create_file, referred to by integer id.
+static IntResourceManagerCompact<FILE> openfiles([](FILE *f) { fclose(f); });
+static string linebuf;  // Reused, so reading lines doesn't allocate except for the resulting strings.
+static vector<char> chunkbuf;
+
+// other is an argument the caller still owns, which is released before raising an error so it doesn't leak.
+static FILE *GetFile(Value &i, Value *other = nullptr)
+{
+    auto f = openfiles.Get(i.ival());
+    if (!f)
+    {
+        if (other) other->DECRT();
+        g_vm->BuiltinError("illegal file id: " + to_string(i.ival()));
+    }
+    return f;
+}
+
 void AddFileOps()
 {
     STARTDECL(scan_folder) (Value &fld, Value &divisor)
@@ -119,8 +270,43 @@ void AddFileOps()
         " Specify 1 as divisor to get sizes in bytes, 1024 for kb etc. Values > 0x7FFFFFFF will be clamped."
         " Returns nil if folder couldn't be scanned.");
 
+    STARTDECL(scan_tree) (Value &fld, Value &filter)
+    {
+        TreeScan ts;
+        ts.root = FindFolder(fld.sval()->str());
+        fld.DECRT();
+        if (!ts.root.empty() && ts.root.back() != '/' && ts.root.back() != '\\') ts.root += "/";
+        string pat = filter.True() ? filter.sval()->str() : "";
+        filter.DECRTNIL();
+        ts.filter = pat.empty() ? nullptr : pat.c_str();
+        ts.names  = (LVector *)g_vm->NewVector(0, 0, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_STRING));
+        ts.sizes  = (LVector *)g_vm->NewVector(0, 0, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_INT));
+        ts.mtimes = (LVector *)g_vm->NewVector(0, 0, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_INT));
+        if (!ts.root.empty()) ts.Scan("");
+        g_vm->Push(Value(ts.names));
+        g_vm->Push(Value(ts.sizes));
+        return Value(ts.mtimes);
+    }
+    ENDDECL2(scan_tree, "folder,filter", "SS?", "S]I]I]",
+        "returns three vectors describing all files in a folder and all its sub-folders: their paths relative"
+        " to folder (using / as separator), their sizes in bytes (values > 0x7FFFFFFF will be clamped), and"
+        " their modification times (seconds since 1970). filter is an optional pattern that file names must"
+        " match, using * and ? as wildcards, e.g. \"*.png\". Folders that can't be read are skipped. folder is"
+        " looked for in the folder write_file writes to first, then where read_file looks.");
+
     STARTDECL(read_file) (Value &file)
     {
+        if (auto f = OpenForReading(file.sval()->str()))
+        {
+            auto s = ReadIntoString(f, 0, -1);
+            fclose(f);
+            if (s)
+            {
+                file.DECRT();
+                return Value(s);
+            }
+        }
+        // Fall back on the platform loader, which can also find files packaged with the app.
         size_t sz = 0;
         auto buf = (char *)LoadFile(file.sval()->str(), &sz);
         file.DECRT();
@@ -133,6 +319,125 @@ void AddFileOps()
         "returns the contents of a file as a string, or nil if the file can't be found."
         " you may use either \\ or / as path separators");
 
+    STARTDECL(read_file_range) (Value &file, Value &offset, Value &len)
+    {
+        auto f = OpenForReading(file.sval()->str());
+        file.DECRT();
+        if (!f) return Value();
+        auto s = ReadIntoString(f, offset.ival(), len.ival());
+        fclose(f);
+        return s ? Value(s) : Value();
+    }
+    ENDDECL3(read_file_range, "file,offset,len", "SII", "S?",
+        "returns len bytes of a file starting at offset (fewer if the file ends before that, none if offset is"
+        " past the end, and the rest of the file if len < 0) as a string, or nil if the file can't be read."
+        " Useful to process large files in pieces without loading all of them.");
+
+    STARTDECL(file_size) (Value &file)
+    {
+        auto f = OpenForReading(file.sval()->str());
+        file.DECRT();
+        if (!f) return Value(-1);
+        int64_t size = SeekFile(f, 0, SEEK_END) ? TellFile(f) : -1;
+        fclose(f);
+        return Value((int)min(size, (int64_t)INT_MAX));
+    }
+    ENDDECL1(file_size, "file", "S", "I",
+        "returns the size of a file in bytes (clamped to 0x7FFFFFFF), or -1 if it can't be found.");
+
+    STARTDECL(open_file) (Value &file)
+    {
+        auto f = OpenForReading(file.sval()->str());
+        file.DECRT();
+        return Value(f ? (int)openfiles.Add(f) : 0);
+    }
+    ENDDECL1(open_file, "file", "S", "I",
+        "opens a file for reading with read_line / read_chunk, returns an integer id (1..) for it,"
+        " or 0 if it can't be opened. Lets you process files too big to fit in memory.");
+
+    STARTDECL(read_line) (Value &i)
+    {
+        auto f = GetFile(i);
+        char buf[4096];
+        linebuf.clear();
+        while (fgets(buf, sizeof(buf), f))
+        {
+            linebuf += buf;
+            if (linebuf.back() == '\n') break;
+        }
+        if (linebuf.empty()) return Value();
+        if (linebuf.back() == '\n') linebuf.pop_back();
+        if (!linebuf.empty() && linebuf.back() == '\r') linebuf.pop_back();
+        return Value(g_vm->NewString(linebuf));
+    }
+    ENDDECL1(read_line, "file", "I", "S?",
+        "returns the next line (without the line ending) from a file opened with open_file, or nil at the end"
+        " of the file. See also lines() in std.lobster.");
+
+    STARTDECL(read_chunk) (Value &i, Value &size)
+    {
+        auto f = GetFile(i);
+        if (size.ival() <= 0) g_vm->BuiltinError("read_chunk: size must be positive");
+        chunkbuf.resize(size.ival());
+        auto len = fread(chunkbuf.data(), 1, chunkbuf.size(), f);
+        return len ? Value(g_vm->NewString(chunkbuf.data(), len)) : Value();
+    }
+    ENDDECL2(read_chunk, "file,size", "II", "S?",
+        "returns the next size bytes (fewer at the end) from a file opened with open_file, or nil if there is"
+        " nothing left. size must be > 0.");
+
+    STARTDECL(create_file) (Value &file, Value &append, Value &buffersize)
+    {
+        auto f = OpenForWriting(file.sval()->str(), true, append.True());
+        file.DECRT();
+        if (!f) return Value(0);
+        auto bs = buffersize.ival() > 0 ? buffersize.ival() : 64 * 1024;
+        setvbuf(f, nullptr, _IOFBF, bs);
+        return Value((int)openfiles.Add(f));
+    }
+    ENDDECL3(create_file, "file,append,buffersize", "SI?I?", "I",
+        "opens a file for writing with write / write_line, returns an integer id (1..) for it, or 0 if it can't"
+        " be opened. Truncates the file, or appends to it if append is true. Writes are collected in a buffer"
+        " of buffersize bytes (default 64kb) before going to the file. Lets you write files too big to build"
+        " as a single string.");
+
+    STARTDECL(write) (Value &i, Value &s)
+    {
+        auto f = GetFile(i, &s);
+        auto ok = fwrite(s.sval()->str(), 1, s.sval()->len, f) == (size_t)s.sval()->len;
+        s.DECRT();
+        return Value(ok);
+    }
+    ENDDECL2(write, "file,s", "IS", "I",
+        "writes a string to a file opened with create_file, returns false if writing wasn't possible");
+
+    STARTDECL(write_line) (Value &i, Value &s)
+    {
+        auto f = GetFile(i, &s);
+        auto ok = fwrite(s.sval()->str(), 1, s.sval()->len, f) == (size_t)s.sval()->len && fputc('\n', f) != EOF;
+        s.DECRT();
+        return Value(ok);
+    }
+    ENDDECL2(write_line, "file,s", "IS", "I",
+        "writes a string followed by a line ending to a file opened with create_file, returns false if"
+        " writing wasn't possible");
+
+    STARTDECL(flush) (Value &i)
+    {
+        return Value(!fflush(GetFile(i)));
+    }
+    ENDDECL1(flush, "file", "I", "I",
+        "writes out anything still buffered for a file opened with create_file, returns false if writing"
+        " wasn't possible");
+
+    STARTDECL(close_file) (Value &i)
+    {
+        openfiles.Delete(i.ival());
+        return Value();
+    }
+    ENDDECL1(close_file, "file", "I", "",
+        "closes a file opened with open_file or create_file (writing out anything still buffered).");
+
     STARTDECL(write_file) (Value &file, Value &contents)
     {
         FILE *f = OpenForWriting(file.sval()->str(), true);
@@ -178,6 +178,37 @@ typedef vec<int,4> int4;
 
 typedef vec<uchar,4> byte4;
 
+#ifdef PLATFORM_SSE2
+    #include <emmintrin.h>
+
+    // vec keeps its plain T c[N] storage (it is embedded in vertex structs, IQM data etc.), so the SSE paths use
+    // unaligned loads and stores, which are as fast as aligned ones when the data happens to be aligned.
+    inline __m128 tosse(const float4 &v) { return _mm_loadu_ps(v.data()); }
+    inline float4 fromsse(__m128 m) { float f[4]; _mm_storeu_ps(f, m); return float4(f); }
+
+    // Each operator loads both sides, applies op and stores the result, arg is the right hand side parameter and
+    // rhs turns it into an __m128.
+    #define SSEOP(OP, op, arg, rhs) \
+        template<> inline float4 float4::operator OP(arg) const { return fromsse(op(tosse(*this), rhs)); }
+    #define SSEASSIGNOP(OP, op, arg, rhs) \
+        template<> inline float4 &float4::operator OP(arg) { _mm_storeu_ps(c, op(tosse(*this), rhs)); return *this; }
+
+    SSEOP(+, _mm_add_ps, const float4 &v, tosse(v))
+    SSEOP(-, _mm_sub_ps, const float4 &v, tosse(v))
+    SSEOP(*, _mm_mul_ps, const float4 &v, tosse(v))
+    SSEOP(/, _mm_div_ps, const float4 &v, tosse(v))
+
+    SSEOP(*, _mm_mul_ps, float e, _mm_set1_ps(e))
+    SSEOP(/, _mm_div_ps, float e, _mm_set1_ps(e))
+
+    SSEASSIGNOP(+=, _mm_add_ps, const float4 &v, tosse(v))
+    SSEASSIGNOP(-=, _mm_sub_ps, const float4 &v, tosse(v))
+    SSEASSIGNOP(*=, _mm_mul_ps, float e, _mm_set1_ps(e))
+
+    #undef SSEOP
+    #undef SSEASSIGNOP
+#endif
+
 const float4 float4_0 = float4(0.0f);
 const float4 float4_1 = float4(1.0f);
 
@@ -389,16 +420,54 @@ typedef matrix<float,3,3> float3x3;
 typedef matrix<float,3,4> float3x4;
 typedef matrix<float,4,3> float4x3;
 
+#ifdef PLATFORM_SSE2
+    // sum of the columns scaled by the components of v, starting from 0 like the scalar version does, so the
+    // results are bit identical (0 + -0 is +0).
+    inline __m128 mulcolumns(const __m128 cols[4], const float4 &v)
+    {
+        __m128 r = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(cols[0], _mm_set1_ps(v.x())));
+        r = _mm_add_ps(r, _mm_mul_ps(cols[1], _mm_set1_ps(v.y())));
+        r = _mm_add_ps(r, _mm_mul_ps(cols[2], _mm_set1_ps(v.z())));
+        return _mm_add_ps(r, _mm_mul_ps(cols[3], _mm_set1_ps(v.w())));
+    }
+
+    template<> inline float4 float4x4::operator*(const float4 &v) const
+    {
+        __m128 cols[] = { tosse(m[0]), tosse(m[1]), tosse(m[2]), tosse(m[3]) };
+        return fromsse(mulcolumns(cols, v));
+    }
+
+    template<> inline float4x4 float4x4::operator*(const float4x4 &o) const
+    {
+        __m128 cols[] = { tosse(m[0]), tosse(m[1]), tosse(m[2]), tosse(m[3]) };
+        float4x4 res;
+        for (int x = 0; x < 4; x++) res.m[x] = fromsse(mulcolumns(cols, o.m[x]));
+        return res;
+    }
+#endif
+
 const float4x4 float4x4_1 = float4x4(1);
 const float3x3 float3x3_1 = float3x3(1);
 
 inline float3x4 operator*(const float3x4 &m, const float3x4 &o)     // FIXME: clean this up
 {
-    
-    return float3x4(
-        (o[0]*m[0].x() + o[1]*m[0].y() + o[2]*m[0].z()).add(3, m[0].w()),
-        (o[0]*m[1].x() + o[1]*m[1].y() + o[2]*m[1].z()).add(3, m[1].w()),
-        (o[0]*m[2].x() + o[1]*m[2].y() + o[2]*m[2].z()).add(3, m[2].w()));
+    #ifdef PLATFORM_SSE2
+        __m128 o0 = tosse(o[0]), o1 = tosse(o[1]), o2 = tosse(o[2]);
+        float4 r[3];
+        for (int i = 0; i < 3; i++)
+        {
+            __m128 v = _mm_add_ps(_mm_mul_ps(o0, _mm_set1_ps(m[i].x())), _mm_mul_ps(o1, _mm_set1_ps(m[i].y())));
+            v = _mm_add_ps(v, _mm_mul_ps(o2, _mm_set1_ps(m[i].z())));
+            // adding -0 leaves xyz untouched, including the sign of zero
+            r[i] = fromsse(_mm_add_ps(v, _mm_setr_ps(-0.0f, -0.0f, -0.0f, m[i].w())));
+        }
+        return float3x4(r[0], r[1], r[2]);
+    #else
+        return float3x4(
+            (o[0]*m[0].x() + o[1]*m[0].y() + o[2]*m[0].z()).add(3, m[0].w()),
+            (o[0]*m[1].x() + o[1]*m[1].y() + o[2]*m[1].z()).add(3, m[1].w()),
+            (o[0]*m[2].x() + o[1]*m[2].y() + o[2]*m[2].z()).add(3, m[2].w()));
+    #endif
 }
 
 inline float4x4 translation(const float3 &t)
@@ -499,10 +568,18 @@ inline float3x3 rotation(const quat &q)
 inline float3x4 rotationscaletrans(const quat &q, const float3 &s, const float3 &t)
 {
     float3x3 m = rotation(q);
-    for (int i = 0; i < 3; i++) m.set(i, m[i] * s);
-    return float3x4(float4(m[0], t.x()),
-                    float4(m[1], t.y()),
-                    float4(m[2], t.z()));
+    #ifdef PLATFORM_SSE2
+        // scale and append the translation in one go, w * 1 is exact
+        __m128 scale = _mm_setr_ps(s.x(), s.y(), s.z(), 1);
+        return float3x4(fromsse(_mm_mul_ps(tosse(float4(m[0], t.x())), scale)),
+                        fromsse(_mm_mul_ps(tosse(float4(m[1], t.y())), scale)),
+                        fromsse(_mm_mul_ps(tosse(float4(m[2], t.z())), scale)));
+    #else
+        for (int i = 0; i < 3; i++) m.set(i, m[i] * s);
+        return float3x4(float4(m[0], t.x()),
+                        float4(m[1], t.y()),
+                        float4(m[2], t.z()));
+    #endif
 }
 
 inline float4x4 float3x3to4x4(const float3x3 &m)
@@ -515,11 +592,24 @@ inline float4x4 float3x3to4x4(const float3x3 &m)
 
 inline float3x4 invertortho(const float3x4 &o) // FIXME: this is not generic, here because of IQM
 {
-    float4x3 inv = o.transpose();
-    for (int i = 0; i < 3; i++) inv.set(i, inv[i] / squaredlength(inv[i]));
-    return float3x4(float4(inv[0], -dot(inv[0], inv[3])),
-                    float4(inv[1], -dot(inv[1], inv[3])),
-                    float4(inv[2], -dot(inv[2], inv[3])));
+    #ifdef PLATFORM_SSE2
+        // the transposed rows are the lanes of o's rows, so this is all vertical, in the same order as below
+        __m128 o0 = tosse(o[0]), o1 = tosse(o[1]), o2 = tosse(o[2]);
+        __m128 sqlen = _mm_add_ps(_mm_add_ps(_mm_mul_ps(o0, o0), _mm_mul_ps(o1, o1)), _mm_mul_ps(o2, o2));
+        __m128 s0 = _mm_div_ps(o0, sqlen), s1 = _mm_div_ps(o1, sqlen), s2 = _mm_div_ps(o2, sqlen);
+        __m128 d = _mm_add_ps(_mm_setzero_ps(), _mm_mul_ps(s0, _mm_set1_ps(o[0].w())));
+        d = _mm_add_ps(d, _mm_mul_ps(s1, _mm_set1_ps(o[1].w())));
+        d = _mm_add_ps(d, _mm_mul_ps(s2, _mm_set1_ps(o[2].w())));
+        d = _mm_xor_ps(d, _mm_set1_ps(-0.0f));
+        _MM_TRANSPOSE4_PS(s0, s1, s2, d);
+        return float3x4(fromsse(s0), fromsse(s1), fromsse(s2));
+    #else
+        float4x3 inv = o.transpose();
+        for (int i = 0; i < 3; i++) inv.set(i, inv[i] / squaredlength(inv[i]));
+        return float3x4(float4(inv[0], -dot(inv[0], inv[3])),
+                        float4(inv[1], -dot(inv[1], inv[3])),
+                        float4(inv[2], -dot(inv[2], inv[3])));
+    #endif
 }
 
 // handedness: 1.f for RH, -1.f for LH
@@ -38,6 +38,10 @@ float3 lastframehitsize = float3_0;
 
 bool graphics_initialized = false;
 
+extern int NoiseGridArgs(const char *name, Value &size, Value &offset, int3 &isize, float4 &origin);
+extern void simplexNoiseGrid(const int octaves, const float persistence, const float scale, const float4 &origin,
+                             int dims, const int3 &size, float *out);
+
 void GraphicsShutDown()  // should be safe to call even if it wasn't initialized partially or at all
 {
     extern void CleanPhysics(); CleanPhysics();
@@ -1037,6 +1041,35 @@ void AddGraphics()
              "creates a blank texture (for use with e.g. compute shaders), returns texture id."
              " see color.lobster for texture format");
 
+    STARTDECL(gl_createnoisetexture) (Value &size_, Value &octaves, Value &scale, Value &persistence, Value &offset,
+                                      Value &tf)
+    {
+        TestGL();
+
+        int3 size;
+        float4 origin;
+        auto dims = NoiseGridArgs("gl_createnoisetexture", size_, offset, size, origin);
+        if (size.z() != 1) g_vm->BuiltinError("gl_createnoisetexture: size must be 2D");
+        auto n = size.x() * size.y();
+        // Noise is computed into the start of the buffer, then expanded to colors back to front in place.
+        auto sz = tf.ival() & TF_FLOAT ? sizeof(float4) : sizeof(byte4);
+        auto buf = new uchar[n * sz];
+        auto noise = (float *)buf;
+        simplexNoiseGrid(octaves.ival(), persistence.fval(), scale.fval(), origin, dims, size, noise);
+        for (int i = n - 1; i >= 0; i--)
+        {
+            auto col = float4(float3((noise[i] + 1) / 2), 1);
+            if (tf.ival() & TF_FLOAT) ((float4 *)buf)[i] = col;
+            else                      ((byte4  *)buf)[i] = quantizec(col);
+        }
+        uint id = CreateTexture(buf, size.xy(), tf.ival());
+        delete[] buf;
+        return Value((int)id);
+    }
+    ENDDECL6(gl_createnoisetexture, "size,octaves,scale,persistence,offset,textureformat", "I]IFFF]?I?", "I",
+        "creates a greyscale texture of simplex noise directly, the same values as simplex_grid() but mapped"
+        " to [0..1]. returns texture id. see color.lobster for texture format");
+
     STARTDECL(gl_deletetexture) (Value &i)
     {
         auto it = texturecache.begin();
@@ -162,7 +162,9 @@ struct Struct : Named
 
     flatbuffers::Offset<bytecode::Struct> Serialize(flatbuffers::FlatBufferBuilder &fbb)
     {
-        return bytecode::CreateStruct(fbb, fbb.CreateString(name), idx, (int)fields.size());
+        vector<flatbuffers::Offset<flatbuffers::String>> fns;
+        for (auto &field : fields.v) fns.push_back(fbb.CreateString(field.id->name));
+        return bytecode::CreateStruct(fbb, fbb.CreateString(name), idx, (int)fields.size(), fbb.CreateVector(fns));
     }
 };
 
@@ -342,18 +344,18 @@ inline string TypeName(TypeRef type)
 
 struct SymbolTable
 {
-    map<string, Ident *> idents;
+    unordered_map<string, Ident *> idents;
     vector<Ident *> identtable;
     vector<Ident *> identstack;
     vector<SpecIdent *> specidents; 
 
-    map<string, Struct *> structs;
+    unordered_map<string, Struct *> structs;
     vector<Struct *> structtable;
 
-    map<string, SharedField *> fields;
+    unordered_map<string, SharedField *> fields;
     vector<SharedField *> fieldtable;
 
-    map<string, Function *> functions;
+    unordered_map<string, Function *> functions;
     vector<Function *> functiontable;
     vector<SubFunction *> subfunctiontable;
 
@@ -17,7 +17,7 @@
 
 namespace lobster
 {
-    const int LOBSTER_BYTECODE_FORMAT_VERSION = 2;
+    const int LOBSTER_BYTECODE_FORMAT_VERSION = 4;
 
 #define ILNAMES \
     F(PUSHINT) \
@@ -49,6 +49,7 @@ namespace lobster
     F(LOGNOT) F(LOGNOTREF) \
     F(BINAND) F(BINOR) F(XOR) F(ASL) F(ASR) F(NEG) \
     F(I2F) F(A2S) F(I2A) F(F2A) F(E2B) F(E2BREF) \
+    F(FSQRT) F(FSIN) F(FCOS) F(IABS) F(FABS) F(IMIN) F(IMAX) F(FMIN) F(FMAX) F(ICLAMP) F(FCLAMP) F(FLERP) \
     F(JUMPFAIL) F(JUMPFAILREF) F(JUMPFAILR) F(JUMPFAILRREF) \
     F(JUMPFAILN) F(JUMPFAILNREF) \
     F(JUMPNOFAIL) F(JUMPNOFAILREF) F(JUMPNOFAILR) F(JUMPNOFAILRREF) \
@@ -48,8 +48,7 @@ struct LoadedFile : Line
           islf(false), cont(false), prevline(nullptr), prevlinetok(nullptr) /* prevlineindenttype(0) */
     {
         source = stringsource;
-        if (!source) source = (char *)LoadFile((string("include/") + fn).c_str());
-        if (!source) source = (char *)LoadFile(fn);
+        if (!source) source = LoadSource(fn);
         if (!source) throw string("can't open file: ") + fn;
 
         linestart = p = source;
@@ -59,6 +58,14 @@ struct LoadedFile : Line
         fns.push_back(fn);
     }
 
+    // Files are looked up relative to the include dir first, then the dirs LoadFile searches.
+    static char *LoadSource(const char *fn, size_t *len = nullptr)
+    {
+        auto source = (char *)LoadFile((string("include/") + fn).c_str(), len);
+        if (!source) source = (char *)LoadFile(fn, len);
+        return source;
+    }
+
     void Clean()
     {
         if (source && source != stringsource) free(source);
@@ -136,7 +143,7 @@ struct Lex : LoadedFile
         if (gentokens.size())
         {
             token = gentokens.back().t;
-            sattr = gentokens.back().a;
+            sattr.swap(gentokens.back().a);
             gentokens.pop_back();
             return;
         }
@@ -326,32 +333,16 @@ struct Lex : LoadedFile
                 if (isalpha(c) || c == '_' || c < 0)
                 {
                     while (isalnum(*p) || *p == '_' || *p < 0) p++;
-                    sattr = string(tokenstart, p);
-                    if      (sattr == "nil")       return T_NIL;
-                    else if (sattr == "true")    { sattr = "1"; return T_INT; }
-                    else if (sattr == "false")   { sattr = "0"; return T_INT; }
-                    else if (sattr == "return")    return T_RETURN; 
-                    else if (sattr == "struct")    return T_STRUCT; 
-                    else if (sattr == "value")     return T_VALUE;
-                    else if (sattr == "include")   return T_INCLUDE;
-                    else if (sattr == "int")       return T_INTTYPE;
-                    else if (sattr == "float")     return T_FLOATTYPE;
-                    else if (sattr == "string")    return T_STRTYPE;
-                    else if (sattr == "vector")    return T_VECTTYPE;
-                    else if (sattr == "def")       return T_FUN;
-                    else if (sattr == "is")        return T_IS;
-                    else if (sattr == "from")      return T_FROM;
-                    else if (sattr == "program")   return T_PROGRAM;
-                    else if (sattr == "private")   return T_PRIVATE;
-                    else if (sattr == "coroutine") return T_COROUTINE;
-                    else if (sattr == "enum")      return T_ENUM;
-                    else if (sattr == "typeof")    return T_TYPEOF;
-                    else if (sattr == "var")       return T_VAR;
-                    else if (sattr == "const")     return T_CONST;
-                    else if (sattr == "not")       return T_NOT;
-                    else if (sattr == "and")       { cont = true; return T_AND; }
-                    else if (sattr == "or")        { cont = true; return T_OR; }
-                    else return T_IDENT;
+                    sattr.assign(tokenstart, p);
+                    auto kw = Keywords().find(sattr);
+                    if (kw == Keywords().end()) return T_IDENT;
+                    switch (kw->second)
+                    {
+                        case T_INT: sattr = sattr[0] == 't' ? "1" : "0"; break;  // true / false
+                        case T_AND:
+                        case T_OR:  cont = true; break;
+                    }
+                    return kw->second;
                 }
 
                 if (isdigit(c) || (c == '.' && isdigit(*p)))
@@ -365,8 +356,8 @@ struct Lex : LoadedFile
                         return T_INT;
                     }
                     while (isdigit(*p) || (*p=='.' && !isalpha(*(p + 1)))) p++;
-                    sattr = string(tokenstart, p);
-                    return strchr(sattr.c_str(), '.') ? T_FLOAT : T_INT;
+                    sattr.assign(tokenstart, p);
+                    return sattr.find('.') != string::npos ? T_FLOAT : T_INT;
                 }
 
                 if (c == '.') return T_DOT;
@@ -378,6 +369,39 @@ struct Lex : LoadedFile
         }
     }
 
+    static const unordered_map<string, TType> &Keywords()
+    {
+        static unordered_map<string, TType> keywords;
+        if (keywords.empty())
+        {
+            keywords["nil"] = T_NIL;
+            keywords["true"] = T_INT;
+            keywords["false"] = T_INT;
+            keywords["return"] = T_RETURN;
+            keywords["struct"] = T_STRUCT;
+            keywords["value"] = T_VALUE;
+            keywords["include"] = T_INCLUDE;
+            keywords["int"] = T_INTTYPE;
+            keywords["float"] = T_FLOATTYPE;
+            keywords["string"] = T_STRTYPE;
+            keywords["vector"] = T_VECTTYPE;
+            keywords["def"] = T_FUN;
+            keywords["is"] = T_IS;
+            keywords["from"] = T_FROM;
+            keywords["program"] = T_PROGRAM;
+            keywords["private"] = T_PRIVATE;
+            keywords["coroutine"] = T_COROUTINE;
+            keywords["enum"] = T_ENUM;
+            keywords["typeof"] = T_TYPEOF;
+            keywords["var"] = T_VAR;
+            keywords["const"] = T_CONST;
+            keywords["not"] = T_NOT;
+            keywords["and"] = T_AND;
+            keywords["or"] = T_OR;
+        }
+        return keywords;
+    }
+
     char HexDigit(char c)
     {
         if (isdigit(c)) return c - '0';
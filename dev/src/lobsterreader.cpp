@@ -17,204 +17,1083 @@
 #include "vmdata.h"
 #include "natreg.h"
 
-#include "ttypes.h"
-#include "lex.h"
+#include "unicode.h"
+
+#include "flatbuffers/flatbuffers.h"
+
+#ifdef PLATFORM_SSE2
+    #include <emmintrin.h>
+#endif
 
 using namespace lobster;
 
+// Reads data in the literal subset of lobster syntax, i.e. what you get if you convert a data structure to a string.
+// This works directly on the input rather than on tokens, and builds values in place: containers are created before
+// their elements are parsed, so if parsing fails halfway, releasing the container releases everything read so far.
+
 struct ValueParser
 {
-    vector<string> filenames;
-    vector<RefObj *> allocated;
-    Lex lex;
+    const char *src, *p;
+    const char *srcname;
+    bool comments;
+    string strbuf;
+    unordered_map<const TypeInfo *, string> structnames;
 
-    ValueParser(char *_src) : lex("string", filenames, _src)
+    ValueParser(const char *_src, const char *_srcname = "string")
+        : src(_src), p(_src), srcname(_srcname), comments(true) {}
+
+    Value Parse(type_elem_t typeoff)
     {
+        Value v = ParseFactor(typeoff);
+        SkipWhiteSpace();
+        if (*p)
+        {
+            v.DECTYPE(g_vm->GetTypeInfo(typeoff).t);
+            Error("end of data expected, found: " + Found());
+        }
+        return v;
     }
 
-    ~ValueParser()
+    void Error(const string &err)
     {
-        for (auto lo : allocated) lo->Dec();
+        auto line = 1 + std::count(src, p, '\n');
+        throw srcname + ("(" + to_string(line) + "): error: " + err);
     }
 
-    Value Parse(type_elem_t typeoff)
+    string Found()
     {
-        Value v = ParseFactor(typeoff);
-        Gobble(T_LINEFEED);
-        Expect(T_ENDOFFILE);
-        return v;
+        if (!*p) return "end of data";
+        auto e = p;
+        while (*e > ' ' && e - p < 20) e++;
+        return string(p, max(e, p + 1));
     }
 
-    Value ParseElems(TType end, type_elem_t typeoff, int numelems = -1)  // Vector or struct.
+    void SkipWhiteSpace()
     {
-        Gobble(T_LINEFEED);
-        vector<Value> elems;
-        auto &ti = g_vm->GetTypeInfo(typeoff);
+        for (;;) switch (*p)
+        {
+            case ' ': case '\t': case '\r': case '\n': case '\f':
+                p++;
+                break;
+            case '/':
+                if (!comments) return;
+                if (p[1] == '/')
+                {
+                    while (*p != '\n' && *p) p++;
+                    break;
+                }
+                if (p[1] == '*')
+                {
+                    auto end = strstr(p + 2, "*/");
+                    if (!end) Error("end of data in multi-line comment");
+                    p = end + 2;
+                    break;
+                }
+                return;
+            default:
+                return;
+        }
+    }
 
-        if (lex.token == end) lex.Next();
+    void Expect(char c)
+    {
+        SkipWhiteSpace();
+        if (*p != c) Error(string("\'") + c + "\' expected, found: " + Found());
+        p++;
+    }
+
+    static bool IsIdentStart(char c) { return isalpha(c) || c == '_' || c < 0; }
+
+    // Returns wether the identifier at p is name, and skips it if so.
+    bool Ident(const char *name, size_t len)
+    {
+        if (strncmp(p, name, len) || isalnum(p[len]) || p[len] == '_' || p[len] < 0) return false;
+        p += len;
+        return true;
+    }
+
+    int HexDigit(char c)
+    {
+        if (isdigit(c)) return c - '0';
+        if (isxdigit(c)) return c - (c < 'a' ? 'A' : 'a') + 10;
+        return -1;
+    }
+
+    char Escape()
+    {
+        char c = *p++;
+        switch (c)
+        {
+            case 'n': return '\n';
+            case 't': return '\t';
+            case 'r': return '\r';
+            case '\\':
+            case '\"':
+            case '\'': return c;
+            case 'x':
+                if (!isxdigit(p[0]) || !isxdigit(p[1])) Error("illegal hexadecimal escape code in string constant");
+                p += 2;
+                return (char)((HexDigit(p[-2]) << 4) | HexDigit(p[-1]));
+            default:
+                p--;
+                Error("unknown control code in string constant");
+                return 0;
+        }
+    }
+
+    // Strings without escape codes (the common case) are copied straight from the input.
+    Value ParseString()
+    {
+        p++;
+        if (p[0] == '\"' && p[1] == '\"')
+        {
+            p += 2;
+            auto end = strstr(p, "\"\"\"");
+            if (!end) Error("end of data found in multi-line string constant");
+            strbuf.clear();
+            for (; p < end; p++) if (*p != '\r') strbuf += *p;
+            p += 3;
+            return Value(g_vm->NewString(strbuf));
+        }
+        auto start = p;
+        while (*p != '\"' && *p != '\\' && (uchar)*p >= ' ') p++;
+        if (*p == '\"') return Value(g_vm->NewString(start, p++ - start));
+        strbuf.assign(start, p);
+        for (;;)
+        {
+            char c = *p++;
+            if (c == '\"') break;
+            if (c == '\\') c = Escape();
+            else if ((uchar)c < ' ') { p--; Error("end of line found in string constant"); }
+            strbuf += c;
+        }
+        return Value(g_vm->NewString(strbuf));
+    }
+
+    int ParseCharConstant()
+    {
+        p++;
+        int ival = 0, len = 0;
+        for (;;)
+        {
+            char c = *p++;
+            if (c == '\'') break;
+            if (c == '\\') c = Escape();
+            else if ((uchar)c < ' ') { p--; Error("end of line found in character constant"); }
+            if (++len > 4) Error("character constant too long");
+            ival = (ival << 8) + c;
+        }
+        return ival;
+    }
+
+    // Numbers are accumulated into an integer mantissa and a decimal exponent. Floats whose mantissa and exponent
+    // are both small enough are exactly representable as doubles, so a single multiply or divide rounds correctly.
+    // Only the rare remaining ones go through strtod.
+    Value ParseNumber(ValueType vt)
+    {
+        bool neg = *p == '-';
+        if (neg) { p++; SkipWhiteSpace(); }
+        int ival = 0;
+        bool isint = true;
+        if (*p == '\'') ival = ParseCharConstant();
+        else if (Ident("true", 4)) ival = 1;
+        else if (Ident("false", 5)) ival = 0;
+        else if (p[0] == '0' && p[1] == 'x')
+        {
+            p += 2;
+            while (isxdigit(*p)) ival = (ival << 4) | HexDigit(*p++);
+        }
         else
         {
-            for (;;)
+            auto start = p;
+            uint64_t mant = 0;
+            int digits = 0, exp10 = 0;
+            bool exact = true;
+            auto digit = [&](int d, bool frac)
             {
-                if ((int)elems.size() == numelems)
+                if (digits < 19)
                 {
-                    ParseFactor(TYPE_ELEM_ANY).DECRT();  // Ignore the value.
+                    mant = mant * 10 + d;
+                    if (mant) digits++;
+                    if (frac) exp10--;
                 }
                 else
                 {
-                    elems.push_back(ParseFactor(ti.t == V_VECTOR ? ti.subt : ti.elems[elems.size()]));
+                    exact = false;
+                    if (!frac) exp10++;
                 }
-                bool haslf = lex.token == T_LINEFEED;
-                if (haslf) lex.Next();
-                if (lex.token == end) break;
-                if (!haslf) Expect(T_COMMA);
+            };
+            while (isdigit(*p)) digit(*p++ - '0', false);
+            if (*p == '.' && !isalpha(p[1]))
+            {
+                isint = false;
+                p++;
+                while (isdigit(*p)) digit(*p++ - '0', true);
+            }
+            if (p == start || (p == start + 1 && !isint)) { p = start; Error("number expected, found: " + Found()); }
+            if ((*p == 'e' || *p == 'E') &&
+                (isdigit(p[1]) || ((p[1] == '-' || p[1] == '+') && isdigit(p[2]))))
+            {
+                isint = false;
+                p++;
+                bool eneg = *p == '-';
+                if (*p == '-' || *p == '+') p++;
+                int e = 0;
+                while (isdigit(*p)) { if (e < 10000) e = e * 10 + *p - '0'; p++; }
+                exp10 += eneg ? -e : e;
+            }
+            if (isint)
+            {
+                ival = (int)mant;
+            }
+            else
+            {
+                if (vt == V_INT) Error("type int required, float given");
+                static const double pow10[] =
+                {
+                    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+                };
+                double f;
+                if (exact && mant < (1ULL << 53) && exp10 >= -22 && exp10 <= 22)
+                    f = exp10 < 0 ? mant / pow10[-exp10] : mant * pow10[exp10];
+                else
+                    f = strtod(start, nullptr);
+                return Value((float)(neg ? -f : f));
             }
-            lex.Next();
         }
+        if (neg) ival = -ival;
+        return vt == V_FLOAT ? Value((float)ival) : Value(ival);
+    }
 
-        if (numelems >= 0)
+    Value ParseVector(const TypeInfo &ti)
+    {
+        p++;
+        auto subt = g_vm->GetTypeInfo(ti.subt).t;
+        // For scalars, the number of commas is a cheap and (almost always) exact estimate of the length.
+        int sizehint = 0;
+        if (IsScalar(subt))
         {
-            while ((int)elems.size() < numelems)
+            auto end = strchr(p, ']');
+            if (end) sizehint = (int)std::count(p, end, ',') + 1;
+        }
+        auto vec = (LVector *)g_vm->NewVector(0, sizehint, ti);
+        try
+        {
+            SkipWhiteSpace();
+            if (*p == ']') p++;
+            else for (;;)
             {
-                switch (ti.elems[elems.size()])
-                {
-                    case V_INT:     elems.push_back(Value(0)); break;
-                    case V_FLOAT:   elems.push_back(Value(0.0f)); break;
-                    case V_NIL:     elems.push_back(Value()); break;
-                    default:        lex.Error("no default value possible for missing struct elements");
-                }
+                vec->Push(ParseFactor(ti.subt));
+                SkipWhiteSpace();
+                if (*p == ']') { p++; break; }
+                if (*p != ',') Error("\',\' or \']\' expected, found: " + Found());
+                p++;
             }
         }
-
-        auto vec = g_vm->NewVector((int)elems.size(), (int)elems.size(), ti);
-        vec->Inc();
-        allocated.push_back(vec);
-        int i = 0;
-        for (auto &e : elems) vec->At(i++) = e;
+        catch (string &)
+        {
+            Value(vec).DECRT();
+            throw;
+        }
         return Value(vec);
     }
 
-    void ExpectType(ValueType given, ValueType needed)
+    Value ParseStruct(const TypeInfo &ti)
     {
-        if (given != needed)
+        auto start = p;
+        while (isalnum(*p) || *p == '_' || *p < 0) p++;
+        auto &name = structnames[&ti];
+        if (name.empty()) name = g_vm->StructName(ti);
+        if (name.compare(0, string::npos, start, p - start))
+        {
+            p = start;
+            Error("struct type " + name + " required, " + Found() + " given");
+        }
+        Expect('{');
+        auto st = g_vm->NewVector(ti.len, ti.len, ti);
+        for (int i = 0; i < ti.len; i++)
+        {
+            auto ft = g_vm->GetTypeInfo(ti.elems[i]).t;
+            st->At(i) = ft == V_INT ? Value(0) : ft == V_FLOAT ? Value(0.0f) : Value();
+        }
+        try
+        {
+            int i = 0;
+            SkipWhiteSpace();
+            if (*p == '}') p++;
+            else for (;; i++)
+            {
+                // Too many elements are ignored, missing ones default to 0/nil below.
+                if (i < ti.len) st->At(i) = ParseFactor(ti.elems[i]);
+                else SkipFactor();
+                SkipWhiteSpace();
+                if (*p == '}') { p++; i++; break; }
+                if (*p != ',') Error("\',\' or \'}\' expected, found: " + Found());
+                p++;
+            }
+            for (; i < ti.len; i++)
+            {
+                auto ft = g_vm->GetTypeInfo(ti.elems[i]).t;
+                if (!IsScalar(ft) && ft != V_NIL) Error("no default value possible for missing struct elements");
+            }
+        }
+        catch (string &)
         {
-            lex.Error(string("type ") +
-                      BaseTypeName(needed) +
-                      " required, " +
-                      BaseTypeName(given) +
-                      " given");
+            Value(st).DECRT();
+            throw;
+        }
+        return Value(st);
+    }
+
+    // Parses a value of any type, without building it.
+    void SkipFactor()
+    {
+        SkipWhiteSpace();
+        char end;
+        switch (*p)
+        {
+            case '\"':
+                ParseString().DECRT();
+                return;
+            case '[':
+                end = ']';
+                break;
+            default:
+                if (IsIdentStart(*p) && !Ident("true", 4) && !Ident("false", 5))
+                {
+                    if (Ident("nil", 3)) return;
+                    while (isalnum(*p) || *p == '_' || *p < 0) p++;
+                    Expect('{');
+                    end = '}';
+                    break;
+                }
+                ParseNumber(V_FLOAT);
+                return;
+        }
+        if (end == ']') p++;
+        SkipWhiteSpace();
+        if (*p == end) { p++; return; }
+        for (;;)
+        {
+            SkipFactor();
+            SkipWhiteSpace();
+            if (*p == end) { p++; return; }
+            if (*p != ',') Error(string("\',\' or \'") + end + "\' expected, found: " + Found());
+            p++;
         }
     }
 
     Value ParseFactor(type_elem_t typeoff)
     {
+        SkipWhiteSpace();
         auto &ti = g_vm->GetTypeInfo(typeoff);
         auto vt = ti.t;
+        if (vt == V_NIL)
+        {
+            if (Ident("nil", 3)) return Value();
+            return ParseFactor(ti.subt);
+        }
+        char c = *p;
+        switch (vt)
+        {
+            case V_INT:
+            case V_FLOAT:
+                if (isdigit(c) || c == '-' || c == '.' || c == '\'' || IsIdentStart(c)) return ParseNumber(vt);
+                break;
+            case V_STRING:
+                if (c == '\"') return ParseString();
+                break;
+            case V_VECTOR:
+                if (c == '[') return ParseVector(ti);
+                break;
+            case V_STRUCT:
+                if (IsIdentStart(c)) return ParseStruct(ti);
+                break;
+            default:
+                // TODO: also support boxed parsing as V_ANY.
+                // means boxing int/float, deducing runtime type for V_VECTOR, and finding the existing struct.
+                break;
+        }
+        Error(string("type ") + BaseTypeName(vt) + " required, found: " + Found());
+        return Value();
+    }
+};
 
-        // TODO: also support boxed parsing as V_ANY.
-        // means boxing int/float, deducing runtime type for V_VECTOR, and finding the existing struct.
+static Value ParseData(type_elem_t typeoff, const char *inp)
+{
+    try
+    {
+        ValueParser parser(inp);
+        g_vm->Push(parser.Parse(typeoff));
+        return Value();
+    }
+    catch (string &s)
+    {
+        g_vm->Push(Value());
+        return Value(g_vm->NewString(s));
+    }
+}
+
+// Compact binary encoding of values, driven by the type table rather than tagged, so it only stores the data itself:
+// ints are zigzag varints, floats 4 bytes little endian, strings and vectors a varint length followed by their
+// contents, structs a varint field count followed by their fields, and nillable values a byte that is 0 for nil.
+// The whole thing starts with such a nil byte too, since the top level value may be nil.
+
+struct ValueWriter
+{
+    string buf;
 
-        switch (lex.token)
+    void WriteVarint(uint u)
+    {
+        while (u >= 0x80) { buf.push_back((char)(u | 0x80)); u >>= 7; }
+        buf.push_back((char)u);
+    }
+
+    void WriteInt(int i) { WriteVarint(((uint)i << 1) ^ (uint)(i >> 31)); }
+
+    void WriteFloat(float f)
+    {
+        char b[sizeof(float)];
+        flatbuffers::WriteScalar(b, f);
+        buf.append(b, sizeof(float));
+    }
+
+    void WriteRef(RefObj *r, int depth)
+    {
+        if (depth > 1000) throw string("data too deeply nested, or cyclic");
+        switch (r->ti.t)
         {
-            case T_INT:
-            { 
-                ExpectType(V_INT, vt);
-                int i = atoi(lex.sattr.c_str());
-                lex.Next();
-                return Value(i);
+            case V_STRING:
+            {
+                auto s = (LString *)r;
+                WriteVarint(s->len);
+                buf.append(s->str(), s->len);
+                break;
             }
 
-            case T_FLOAT:
+            case V_VECTOR:
+            case V_STRUCT:
             {
-                ExpectType(V_FLOAT, vt);
-                double f = atof(lex.sattr.c_str());
-                lex.Next();
-                return Value((float)f);
+                auto e = (ElemObj *)r;
+                int len = e->Len();
+                WriteVarint(len);
+                for (int i = 0; i < len; i++)
+                    Write(e->At(i), r->ti.t == V_VECTOR ? r->ti.subt : r->ti.elems[i], depth + 1);
+                break;
             }
 
-            case T_STR:
+            default:
+                throw string("can't serialize type ") + BaseTypeName(r->ti.t);
+        }
+    }
+
+    void Write(const Value &v, type_elem_t typeoff, int depth)
+    {
+        auto &ti = g_vm->GetTypeInfo(typeoff);
+        switch (ti.t)
+        {
+            case V_INT:   WriteInt(v.ival()); break;
+            case V_FLOAT: WriteFloat(v.fval()); break;
+            case V_NIL:
+                buf.push_back(v.refnil() != nullptr);
+                if (v.refnil()) WriteRef(v.ref(), depth);
+                break;
+            case V_STRING:
+            case V_VECTOR:
+            case V_STRUCT:
+                WriteRef(v.ref(), depth);
+                break;
+            default:
+                throw string("can't serialize type ") + BaseTypeName(ti.t);
+        }
+    }
+};
+
+struct ValueReader
+{
+    const uchar *p, *end;
+
+    ValueReader(const char *data, size_t len) : p((const uchar *)data), end((const uchar *)data + len) {}
+
+    void Error(const string &err) { throw "deserialize: " + err; }
+
+    void Need(size_t n) { if ((size_t)(end - p) < n) Error("unexpected end of data"); }
+
+    uint ReadVarint()
+    {
+        uint u = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            Need(1);
+            auto b = *p++;
+            u |= (uint)(b & 0x7F) << shift;
+            if (b < 0x80) return u;
+        }
+        Error("corrupt varint");
+        return 0;
+    }
+
+    int ReadInt() { auto u = ReadVarint(); return (int)(u >> 1) ^ -(int)(u & 1); }
+
+    float ReadFloat()
+    {
+        Need(sizeof(float));
+        auto f = flatbuffers::ReadScalar<float>(p);
+        p += sizeof(float);
+        return f;
+    }
+
+    // Every element takes at least minelemsize bytes, so this rejects bogus lengths before allocating for them.
+    int ReadLen(size_t minelemsize)
+    {
+        auto len = ReadVarint();
+        if (len > INT_MAX || (size_t)(end - p) / minelemsize < len) Error("length exceeds data");
+        return (int)len;
+    }
+
+    // Returns a value the caller owns. Containers are created before their elements are read, so if reading fails
+    // halfway, releasing the container releases everything read so far.
+    Value Read(type_elem_t typeoff, int depth)
+    {
+        auto &ti = g_vm->GetTypeInfo(typeoff);
+        // Same limit as ValueWriter, so recursive types in untrusted data can't overflow the stack.
+        if (depth > 1000 && IsRef(ti.t)) Error("data too deeply nested");
+        switch (ti.t)
+        {
+            case V_INT:   return Value(ReadInt());
+            case V_FLOAT: return Value(ReadFloat());
+
+            case V_NIL:
+                Need(1);
+                if (!*p++) return Value();
+                return Read(ti.subt, depth);
+
+            case V_STRING:
             {
-                ExpectType(V_STRING, vt);
-                string s = lex.sattr;
-                lex.Next();
-                auto str = g_vm->NewString(s);
-                str->Inc();
-                allocated.push_back(str);
-                return Value(str);
+                int len = ReadLen(1);
+                auto s = g_vm->NewString((const char *)p, len);
+                p += len;
+                return Value(s);
             }
 
-            case T_NIL:
+            case V_VECTOR:
             {
-                ExpectType(V_NIL, vt);
-                lex.Next();
+                if (g_vm->GetTypeInfo(ti.subt).t == V_FLOAT)
+                {
+                    // Fixed size, so the length check covers all elements and they can be copied straight in.
+                    int len = ReadLen(sizeof(float));
+                    auto vec = (LVector *)g_vm->NewVector(len, len, ti);
+                    for (int i = 0; i < len; i++, p += sizeof(float))
+                        vec->At(i) = Value(flatbuffers::ReadScalar<float>(p));
+                    return Value(vec);
+                }
+                int len = ReadLen(1);
+                auto vec = (LVector *)g_vm->NewVector(0, len, ti);
+                try
+                {
+                    for (int i = 0; i < len; i++) vec->Push(Read(ti.subt, depth + 1));
+                }
+                catch (string &)
+                {
+                    Value(vec).DECRT();
+                    throw;
+                }
+                return Value(vec);
+            }
+
+            case V_STRUCT:
+            {
+                int len = ReadLen(1);
+                if (len > ti.len) Error("data has more fields than struct " + g_vm->StructName(ti));
+                for (int i = len; i < ti.len; i++)
+                {
+                    auto ft = g_vm->GetTypeInfo(ti.elems[i]).t;
+                    if (!IsScalar(ft) && ft != V_NIL)
+                        Error("no default value possible for missing fields of struct " + g_vm->StructName(ti));
+                }
+                auto st = g_vm->NewVector(ti.len, ti.len, ti);
+                // Data written before fields were added gets default values, as in parse_data.
+                for (int i = 0; i < ti.len; i++)
+                {
+                    auto ft = g_vm->GetTypeInfo(ti.elems[i]).t;
+                    st->At(i) = ft == V_INT ? Value(0) : ft == V_FLOAT ? Value(0.0f) : Value();
+                }
+                try
+                {
+                    for (int i = 0; i < len; i++) st->At(i) = Read(ti.elems[i], depth + 1);
+                }
+                catch (string &)
+                {
+                    Value(st).DECRT();
+                    throw;
+                }
+                return Value(st);
+            }
+
+            default:
+                Error(string("can't deserialize type ") + BaseTypeName(ti.t));
                 return Value();
+        }
+    }
+};
+
+// JSON, decoded directly into the types described by the type table. Objects map onto structs by field name (fields
+// missing from the object default to 0/nil, keys that aren't fields are skipped), and arrays onto vectors, or onto
+// structs positionally, so e.g. [ 1, 2 ] works for an xy_f. Numbers are parsed as in parse_data, but only after
+// checking they follow JSON's stricter grammar, and comments are not allowed.
+
+struct JsonParser : ValueParser
+{
+    const char *end;
+    string keybuf;
+    int depth;
+    unordered_map<const TypeInfo *, vector<const char *>> fieldnames;
+
+    JsonParser(const char *_src, size_t len) : ValueParser(_src, "json"), end(_src + len), depth(0)
+    {
+        comments = false;
+    }
+
+    // Skips characters that need no unescaping, 16 at a time where possible.
+    const char *PlainChars(const char *c)
+    {
+        #ifdef PLATFORM_SSE2
+            auto quote = _mm_set1_epi8('\"');
+            auto backslash = _mm_set1_epi8('\\');
+            // Control characters are the bytes below space, compared unsigned by flipping the sign bits.
+            auto sign = _mm_set1_epi8((char)0x80);
+            auto space = _mm_xor_si128(_mm_set1_epi8(' '), sign);
+            for (; end - c >= 16; c += 16)
+            {
+                auto block = _mm_loadu_si128((const __m128i *)c);
+                auto ctrl = _mm_cmplt_epi8(_mm_xor_si128(block, sign), space);
+                auto mask = _mm_movemask_epi8(_mm_or_si128(ctrl, _mm_or_si128(_mm_cmpeq_epi8(block, quote),
+                                                                                 _mm_cmpeq_epi8(block, backslash))));
+                if (mask) return c + LowestBit(mask);
             }
+        #endif
+        while (*c != '\"' && *c != '\\' && (uchar)*c >= ' ') c++;
+        return c;
+    }
 
-            case T_MINUS:
+    Value ParseJsonString()
+    {
+        p++;
+        auto start = p;
+        p = PlainChars(p);
+        if (*p == '\"') return Value(g_vm->NewString(start, p++ - start));
+        strbuf.assign(start, p);
+        for (;;)
+        {
+            char c = *p++;
+            if (c == '\"') break;
+            if ((uchar)c < ' ') { p--; Error("end of data or control character in string"); }
+            if (c != '\\')
+            {
+                strbuf += c;
+                continue;
+            }
+            switch (c = *p++)
             {
-                lex.Next(); 
-                Value v = ParseFactor(typeoff);
-                switch (typeoff)
+                case '\"': case '\\': case '/': strbuf += c; break;
+                case 'b': strbuf += '\b'; break;
+                case 'f': strbuf += '\f'; break;
+                case 'n': strbuf += '\n'; break;
+                case 'r': strbuf += '\r'; break;
+                case 't': strbuf += '\t'; break;
+                case 'u':
                 {
-                    case TYPE_ELEM_INT:   v.setival(v.ival() * -1); break;
-                    case TYPE_ELEM_FLOAT: v.setfval(v.fval() * -1); break;
-                    default: lex.Error("unary minus: numeric value expected");
+                    int u = ParseHex4();
+                    // Surrogate pairs encode code points outside the BMP.
+                    if (u >= 0xD800 && u < 0xDC00 && p[0] == '\\' && p[1] == 'u')
+                    {
+                        p += 2;
+                        int lo = ParseHex4();
+                        if (lo < 0xDC00 || lo >= 0xE000) Error("invalid surrogate pair in string");
+                        u = 0x10000 + ((u - 0xD800) << 10) + (lo - 0xDC00);
+                    }
+                    char buf[7];
+                    ToUTF8(u, buf);
+                    strbuf += buf;
+                    break;
                 }
-                return v;
+                default:
+                    p -= 2;
+                    Error("unknown escape code in string: " + Found());
             }
+            auto plain = PlainChars(p);
+            strbuf.append(p, plain);
+            p = plain;
+        }
+        return Value(g_vm->NewString(strbuf));
+    }
 
-            case T_LEFTBRACKET:
+    int ParseHex4()
+    {
+        int u = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (!isxdigit(*p)) Error("illegal \\\\u escape code in string");
+            u = (u << 4) | HexDigit(*p++);
+        }
+        return u;
+    }
+
+    // Calls f for each element of the array or object at p, which must be of the given kind.
+    // Every nested array or object goes through here, so this is also where nesting is limited, to stop
+    // untrusted input from overflowing the stack (like the limit in ValueReader::Read).
+    template<typename F> void Elements(char open, char close, F f)
+    {
+        if (*p != open) Error(string("\'") + open + "\' expected, found: " + Found());
+        if (++depth > 1000) Error("data too deeply nested");
+        p++;
+        SkipWhiteSpace();
+        if (*p != close)
+        {
+            for (int i = 0;; i++)
             {
-                ExpectType(V_VECTOR, vt);
-                lex.Next();
-                return ParseElems(T_RIGHTBRACKET, typeoff);
+                f(i);
+                SkipWhiteSpace();
+                if (*p == close) break;
+                if (*p != ',') Error(string("\',\' or \'") + close + "\' expected, found: " + Found());
+                p++;
+                SkipWhiteSpace();
             }
+        }
+        p++;
+        depth--;
+    }
+
+    int FieldIndex(const TypeInfo &ti, const char *key, size_t len, int guess)
+    {
+        auto &names = fieldnames[&ti];
+        if (names.empty())
+            for (int i = 0; i < ti.len; i++) names.push_back(g_vm->StructFieldName(ti, i));
+        // Objects usually list their keys in field order, so try the next field first.
+        if (guess < ti.len && !strncmp(names[guess], key, len) && !names[guess][len]) return guess;
+        for (int i = 0; i < ti.len; i++) if (!strncmp(names[i], key, len) && !names[i][len]) return i;
+        return -1;
+    }
 
-            case T_IDENT:
+    Value ParseJsonStruct(const TypeInfo &ti)
+    {
+        auto st = g_vm->NewVector(ti.len, ti.len, ti);
+        for (int i = 0; i < ti.len; i++)
+        {
+            auto ft = g_vm->GetTypeInfo(ti.elems[i]).t;
+            st->At(i) = ft == V_INT ? Value(0) : ft == V_FLOAT ? Value(0.0f) : Value();
+        }
+        try
+        {
+            vector<bool> found(ti.len, false);
+            if (*p == '[')
             {
-                ExpectType(V_STRUCT, vt);
-                string sname = lex.sattr;
-                lex.Next();
-                Expect(T_LEFTCURLY);
-                auto name = g_vm->StructName(ti);
-                if (name != sname) lex.Error("struct type " + name + " required, " + sname + " given");
-                return ParseElems(T_RIGHTCURLY, typeoff, ti.len);
+                Elements('[', ']', [&](int i)
+                {
+                    if (i >= ti.len) Error("too many elements for struct " + g_vm->StructName(ti));
+                    st->At(i) = ParseJson(ti.elems[i]);
+                    found[i] = true;
+                });
             }
+            else
+            {
+                int next = 0;
+                Elements('{', '}', [&](int)
+                {
+                    if (*p != '\"') Error("object key expected, found: " + Found());
+                    auto key = p + 1;
+                    auto keyend = PlainChars(key);
+                    if (*keyend == '\"')
+                    {
+                        p = keyend + 1;
+                    }
+                    else
+                    {
+                        auto ks = ParseJsonString();
+                        keybuf.assign(ks.sval()->str(), ks.sval()->len);
+                        ks.DECRT();
+                        key = keybuf.c_str();
+                        keyend = key + keybuf.size();
+                    }
+                    auto keylen = keyend - key;
+                    Expect(':');
+                    SkipWhiteSpace();
+                    int i = FieldIndex(ti, key, keylen, next);
+                    if (i < 0)
+                    {
+                        SkipJson();
+                        return;
+                    }
+                    auto v = ParseJson(ti.elems[i]);
+                    st->At(i).DECTYPE(g_vm->GetTypeInfo(ti.elems[i]).t);
+                    st->At(i) = v;
+                    found[i] = true;
+                    next = i + 1;
+                });
+            }
+            for (int i = 0; i < ti.len; i++)
+            {
+                auto ft = g_vm->GetTypeInfo(ti.elems[i]).t;
+                if (!found[i] && !IsScalar(ft) && ft != V_NIL)
+                    Error(string("field ") + g_vm->StructFieldName(ti, i) + " of struct " + g_vm->StructName(ti) +
+                          " missing, and has no default value");
+            }
+        }
+        catch (string &)
+        {
+            Value(st).DECRT();
+            throw;
+        }
+        return Value(st);
+    }
 
-            default:
-                lex.Error("illegal start of expression: " + lex.TokStr());
-                return Value();
+    Value ParseJsonVector(const TypeInfo &ti)
+    {
+        auto vec = (LVector *)g_vm->NewVector(0, 0, ti);
+        try
+        {
+            Elements('[', ']', [&](int) { vec->Push(ParseJson(ti.subt)); });
         }
+        catch (string &)
+        {
+            Value(vec).DECRT();
+            throw;
+        }
+        return Value(vec);
+    }
+
+    // Rejects what ParseNumber accepts but JSON doesn't: hex, character constants, whitespace after '-',
+    // leading zeros, and '.' or exponents without digits. true/false are allowed, for bool fields.
+    Value ParseJsonNumber(ValueType vt)
+    {
+        if (*p == 't' || *p == 'f') return ParseNumber(vt);
+        auto c = p;
+        auto digits = [&]() { if (!isdigit(*c)) return false; while (isdigit(*c)) c++; return true; };
+        if (*c == '-') c++;
+        bool ok = *c == '0' ? (c++, true) : digits();
+        if (ok && *c == '.') { c++; ok = digits(); }
+        if (ok && (*c == 'e' || *c == 'E'))
+        {
+            c++;
+            if (*c == '+' || *c == '-') c++;
+            ok = digits();
+        }
+        if (!ok || isalnum(*c) || *c == '_' || *c == '.') Error("invalid number: " + Found());
+        return ParseNumber(vt);
     }
 
-    void Expect(TType t)
+    bool Literal(const char *lit, size_t len)
     {
-        if (lex.token != t)
-            lex.Error(lex.TokStr(t) + " expected, found: " + lex.TokStr());
+        if (strncmp(p, lit, len) || isalnum(p[len])) return false;
+        p += len;
+        return true;
+    }
 
-        lex.Next();
+    void SkipJson()
+    {
+        switch (*p)
+        {
+            case '\"': ParseJsonString().DECRT(); break;
+            case '[':  Elements('[', ']', [&](int) { SkipJson(); }); break;
+            case '{':
+                Elements('{', '}', [&](int)
+                {
+                    if (*p != '\"') Error("object key expected, found: " + Found());
+                    ParseJsonString().DECRT();
+                    Expect(':');
+                    SkipWhiteSpace();
+                    SkipJson();
+                });
+                break;
+            default:
+                if (!Literal("true", 4) && !Literal("false", 5) && !Literal("null", 4)) ParseJsonNumber(V_FLOAT);
+                break;
+        }
     }
 
-    void Gobble(TType t)
+    Value ParseJson(type_elem_t typeoff)
     {
-        if (lex.token == t) lex.Next();
+        SkipWhiteSpace();
+        auto &ti = g_vm->GetTypeInfo(typeoff);
+        if (ti.t == V_NIL)
+        {
+            if (Literal("null", 4)) return Value();
+            return ParseJson(ti.subt);
+        }
+        char c = *p;
+        switch (ti.t)
+        {
+            case V_INT:
+            case V_FLOAT:
+                if (isdigit(c) || c == '-' || c == 't' || c == 'f') return ParseJsonNumber(ti.t);
+                break;
+            case V_STRING:
+                if (c == '\"') return ParseJsonString();
+                break;
+            case V_VECTOR:
+                if (c == '[') return ParseJsonVector(ti);
+                break;
+            case V_STRUCT:
+                if (c == '{' || c == '[') return ParseJsonStruct(ti);
+                break;
+            default:
+                break;
+        }
+        Error(string("type ") + BaseTypeName(ti.t) + " required, found: " + Found());
+        return Value();
     }
 };
 
-static Value ParseData(type_elem_t typeoff, char *inp)
+struct JsonWriter
 {
-    try
+    string buf;
+    unordered_map<const TypeInfo *, vector<string>> keys;  // Field names, quoted and followed by ':'.
+
+    JsonWriter() { buf.reserve(1024); }
+
+    // Writes the fewest significant digits that read back as the same float.
+    void WriteFloat(float f)
     {
-        ValueParser parser(inp);
-        g_vm->Push(parser.Parse(typeoff));
-        return Value();
+        // JSON has no inf or nan.
+        if (f != f || f - f != 0) { buf += "null"; return; }
+        if (f == 0 && signbit(f)) { buf += "-0.0"; return; }  // "-0" would read back as int 0.
+        if (fabsf(f) < 1e9f && f == (int)f) { append_int(buf, (int)f); return; }
+        double d = fabs((double)f);
+        if (d >= 1e-9)
+        {
+            static const double pow10[] =
+            {
+                1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17
+            };
+            int e10 = (int)floor(log10(d));
+            // Not an integer, so at least one decimal is needed, and 9 significant digits always suffice.
+            for (int decimals = max(1, -e10); decimals < 9 - e10; decimals++)
+            {
+                auto m = floor(d * pow10[decimals] + 0.5);
+                if ((float)(m / pow10[decimals]) != (float)d) continue;
+                char num[24];
+                auto e = num + sizeof(num);
+                auto c = e;
+                auto u = (uint64_t)m;
+                for (int i = 0; i < decimals || u; i++)
+                {
+                    if (i == decimals) *--c = '.';
+                    *--c = (char)('0' + u % 10);
+                    u /= 10;
+                    if (i == decimals - 1 && !u) *--c = '.', *--c = '0';
+                }
+                if (f < 0) *--c = '-';
+                while (e[-1] == '0') e--;
+                buf.append(c, e);
+                return;
+            }
+        }
+        char num[32];
+        buf.append(num, snprintf(num, sizeof(num), "%.9g", f));
     }
-    catch (string &s)
+
+    void WriteString(const char *s, size_t len)
     {
-        g_vm->Push(Value());
-        return Value(g_vm->NewString(s));
+        buf.push_back('\"');
+        auto end = s + len;
+        while (s < end)
+        {
+            auto plain = s;
+            while (plain < end && *plain != '\"' && *plain != '\\' && (uchar)*plain >= ' ') plain++;
+            buf.append(s, plain);
+            if (plain == end) break;
+            char c = *plain;
+            s = plain + 1;
+            switch (c)
+            {
+                case '\"': buf += "\\\""; break;
+                case '\\': buf += "\\\\"; break;
+                case '\n': buf += "\\n"; break;
+                case '\r': buf += "\\r"; break;
+                case '\t': buf += "\\t"; break;
+                default:
+                {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\u%04x", (uchar)c);
+                    buf += esc;
+                    break;
+                }
+            }
+        }
+        buf.push_back('\"');
+    }
+
+    void WriteRef(RefObj *r, int depth)
+    {
+        if (depth > 1000) throw string("data too deeply nested, or cyclic");
+        switch (r->ti.t)
+        {
+            case V_STRING:
+                WriteString(((LString *)r)->str(), ((LString *)r)->len);
+                break;
+
+            case V_VECTOR:
+            {
+                auto v = (LVector *)r;
+                buf.push_back('[');
+                for (int i = 0; i < v->len; i++)
+                {
+                    if (i) buf.push_back(',');
+                    Write(v->At(i), r->ti.subt, depth + 1);
+                }
+                buf.push_back(']');
+                break;
+            }
+
+            case V_STRUCT:
+            {
+                auto st = (LStruct *)r;
+                auto &names = keys[&r->ti];
+                if (names.empty())
+                {
+                    for (int i = 0; i < st->Len(); i++)
+                    {
+                        auto name = g_vm->StructFieldName(r->ti, i);
+                        names.push_back("\"" + string(name) + "\":");
+                    }
+                }
+                buf.push_back('{');
+                for (int i = 0; i < st->Len(); i++)
+                {
+                    if (i) buf.push_back(',');
+                    buf += names[i];
+                    Write(st->At(i), r->ti.elems[i], depth + 1);
+                }
+                buf.push_back('}');
+                break;
+            }
+
+            default:
+                throw string("can't convert type ") + BaseTypeName(r->ti.t) + " to json";
+        }
     }
-}
+
+    void Write(const Value &v, type_elem_t typeoff, int depth)
+    {
+        switch (g_vm->GetTypeInfo(typeoff).t)
+        {
+            case V_INT:   append_int(buf, v.ival()); break;
+            case V_FLOAT: WriteFloat(v.fval()); break;
+            case V_NIL:
+                if (v.refnil()) WriteRef(v.ref(), depth);
+                else buf += "null";
+                break;
+            case V_STRING:
+            case V_VECTOR:
+            case V_STRUCT:
+                WriteRef(v.ref(), depth);
+                break;
+            default:
+                throw string("can't convert type ") + BaseTypeName(g_vm->GetTypeInfo(typeoff).t) + " to json";
+        }
+    }
+};
 
 void AddReaderOps()
 {
@@ -231,6 +1110,105 @@ void AddReaderOps()
         " truncated, missing elements will be set to 0/nil if possible."
         " useful for simple file formats. returns the value and an error string as second return value"
         " (or nil if no error)");
+
+    STARTDECL(serialize) (Value &x)
+    {
+        ValueWriter writer;
+        try
+        {
+            writer.buf.push_back(x.refnil() != nullptr);
+            if (x.refnil()) writer.WriteRef(x.ref(), 0);
+        }
+        catch (string &s)
+        {
+            x.DECRTNIL();
+            g_vm->BuiltinError("serialize: " + s);
+        }
+        x.DECRTNIL();
+        return Value(g_vm->NewString(writer.buf));
+    }
+    ENDDECL1(serialize, "x", "A", "S",
+        "converts a data structure to a compact binary string, which deserialize() can turn back into a data"
+        " structure. supports int/float/string/vector and structs, like parse_data, but is smaller and much"
+        " faster to read back.");
+
+    STARTDECL(deserialize) (Value &type, Value &data)
+    {
+        Value v;
+        try
+        {
+            ValueReader reader(data.sval()->str(), data.sval()->len);
+            auto typeoff = (type_elem_t)type.ival();
+            if (g_vm->GetTypeInfo(typeoff).t == V_NIL) typeoff = g_vm->GetTypeInfo(typeoff).subt;
+            if (!IsRef(g_vm->GetTypeInfo(typeoff).t)) reader.Error("type must be a string, vector or struct");
+            Value r;
+            reader.Need(1);
+            if (*reader.p++) r = reader.Read(typeoff, 0);
+            if (reader.p != reader.end) reader.Error("data left over after value");
+            g_vm->Push(r);
+        }
+        catch (string &s)
+        {
+            g_vm->Push(Value());
+            v = Value(g_vm->NewString(s));
+        }
+        data.DECRT();
+        return v;
+    }
+    ENDDECL2(deserialize, "typeid,data", "TS", "A1?S?",
+        "turns a string created by serialize() back into a data structure of the given type. structs may have"
+        " gained fields since the data was written (these are set to 0/nil if possible)."
+        " returns the value and an error string as second return value (or nil if no error)");
+
+    STARTDECL(json_parse) (Value &type, Value &json)
+    {
+        Value v;
+        try
+        {
+            JsonParser parser(json.sval()->str(), json.sval()->len);
+            auto typeoff = (type_elem_t)type.ival();
+            Value r = parser.ParseJson(typeoff);
+            parser.SkipWhiteSpace();
+            if (*parser.p)
+            {
+                r.DECTYPE(g_vm->GetTypeInfo(typeoff).t);
+                parser.Error("end of data expected, found: " + parser.Found());
+            }
+            g_vm->Push(r);
+        }
+        catch (string &s)
+        {
+            g_vm->Push(Value());
+            v = Value(g_vm->NewString(s));
+        }
+        json.DECRT();
+        return v;
+    }
+    ENDDECL2(json_parse, "typeid,json", "TS", "A1?S?",
+        "parses JSON into a data structure of the given type. objects become structs (matched by field name,"
+        " fields missing from the object are set to 0/nil if possible, unknown keys are ignored), arrays become"
+        " vectors (or structs, by position), null becomes nil and true/false become 1/0."
+        " returns the value and an error string as second return value (or nil if no error)");
+
+    STARTDECL(json_emit) (Value &x)
+    {
+        JsonWriter writer;
+        try
+        {
+            if (x.refnil()) writer.WriteRef(x.ref(), 0);
+            else writer.buf += "null";
+        }
+        catch (string &s)
+        {
+            x.DECRTNIL();
+            g_vm->BuiltinError("json_emit: " + s);
+        }
+        x.DECRTNIL();
+        return Value(g_vm->NewString(writer.buf));
+    }
+    ENDDECL1(json_emit, "x", "A", "S",
+        "converts a data structure to JSON: structs become objects, vectors arrays, nil null."
+        " json_parse() can read the result back.");
 }
 
 AutoRegister __aro("parsedata", AddReaderOps);
@@ -32,17 +32,33 @@ using namespace lobster;
 const char *fileheader = "\xA5\x74\xEF\x19";
 const int fileheaderlen = 4;
 
+void Compress(const vector<uchar> &bytecode, vector<uchar> &out)
+{
+    out.insert(out.end(), fileheader, fileheader + fileheaderlen);
+    auto len = (uint)bytecode.size();
+    out.insert(out.end(), (uchar *)&len, (uchar *)&len + sizeof(uint));  // FIXME: not endianness-safe
+    vector<uchar> coded;
+    WEntropyCoder<true>(bytecode.data(), bytecode.size(), bytecode.size(), coded);
+    out.insert(out.end(), coded.begin(), coded.end());
+}
+
+bool Decompress(const uchar *bc, size_t bclen, vector<uchar> &bytecode)
+{
+    if (bclen < fileheaderlen + sizeof(uint) || memcmp(fileheader, bc, fileheaderlen)) return false;
+    uint origlen = *(uint *)(bc + fileheaderlen);
+    bytecode.clear();
+    WEntropyCoder<false>(bc + fileheaderlen + sizeof(uint), bclen - fileheaderlen - sizeof(uint), origlen, bytecode);
+    return true;
+}
+
 void Save(const char *bcf, const vector<uchar> &bytecode)
 {
     vector<uchar> out;
-    WEntropyCoder<true>(bytecode.data(), bytecode.size(), bytecode.size(), out);
+    Compress(bytecode, out);
 
     FILE *f = OpenForWriting(bcf, true);
     if (f)
     {
-        fwrite(fileheader, fileheaderlen, 1, f);
-        auto len = (uint)bytecode.size();
-        fwrite(&len, sizeof(uint), 1, f);  // FIXME: not endianness-safe
         fwrite(out.data(), out.size(), 1, f);
         fclose(f);
     }
@@ -54,16 +70,72 @@ bool Load(const char *bcf, vector<uchar> &bytecode)
     uchar *bc = LoadFile(bcf, &bclen);
     if (!bc) return false;
 
-    if (memcmp(fileheader, bc, fileheaderlen)) { free(bc); throw string("bytecode file corrupt: ") + bcf; }
-    uint origlen = *(uint *)(bc + fileheaderlen);
-    bytecode.clear();
-    WEntropyCoder<false>(bc + fileheaderlen + sizeof(uint), bclen - fileheaderlen - sizeof(uint), origlen, bytecode);
+    if (!Decompress(bc, bclen, bytecode)) { free(bc); throw string("bytecode file corrupt: ") + bcf; }
 
     free(bc);
 
     return VerifyBytecode(bytecode);
 }
 
+// Compile cache: the list of source files a compile read, a hash over their contents and the compiler
+// version, followed by the same compressed bytecode Save() writes. Reused when the hash still matches.
+const char *cacheheader = "\xA5\x74\xEF\x1A";
+
+void SaveCache(const char *cachefn, const vector<string> &filenames, const vector<uchar> &bytecode)
+{
+    uint64_t hash;
+    if (!SourceHash(filenames, hash)) return;
+
+    vector<uchar> out(cacheheader, cacheheader + fileheaderlen);
+    auto numfiles = (uint)filenames.size();
+    out.insert(out.end(), (uchar *)&numfiles, (uchar *)&numfiles + sizeof(uint));
+    for (auto &fn : filenames) out.insert(out.end(), fn.c_str(), fn.c_str() + fn.length() + 1);
+    out.insert(out.end(), (uchar *)&hash, (uchar *)&hash + sizeof(uint64_t));
+    Compress(bytecode, out);
+
+    FILE *f = OpenForWriting(cachefn, true);
+    if (f)
+    {
+        fwrite(out.data(), out.size(), 1, f);
+        fclose(f);
+    }
+}
+
+bool LoadCache(const char *cachefn, vector<uchar> &bytecode)
+{
+    size_t len = 0;
+    uchar *buf = LoadFile(cachefn, &len);
+    if (!buf) return false;
+
+    // Anything that doesn't look right is simply a cache miss.
+    bool ok = false;
+    auto p = buf, end = buf + len;
+    if (len >= fileheaderlen + sizeof(uint) && !memcmp(cacheheader, p, fileheaderlen))
+    {
+        p += fileheaderlen;
+        uint numfiles = *(uint *)p;
+        p += sizeof(uint);
+        vector<string> filenames;
+        for (uint i = 0; i < numfiles && p < end; i++)
+        {
+            auto fnend = (uchar *)memchr(p, 0, end - p);
+            if (!fnend) break;
+            filenames.push_back(string((char *)p, fnend - p));
+            p = fnend + 1;
+        }
+        uint64_t hash;
+        if (filenames.size() == numfiles && end - p >= (ptrdiff_t)sizeof(uint64_t) &&
+            SourceHash(filenames, hash) && !memcmp(&hash, p, sizeof(uint64_t)))
+        {
+            p += sizeof(uint64_t);
+            ok = Decompress(p, end - p, bytecode) && VerifyBytecode(bytecode);
+        }
+    }
+
+    free(buf);
+    return ok;
+}
+
 void Exit(int code)
 {
     extern void GraphicsShutDown(); GraphicsShutDown();
@@ -120,6 +192,8 @@ int main(int argc, char* argv[])
 
         bool parsedump = false;
         bool disasm = false;
+        bool usecache = true;
+        bool timepasses = false;
         const char *default_bcf = "default.lbc";
         const char *bcf = nullptr;
 
@@ -131,6 +205,8 @@ int main(int argc, char* argv[])
             else if (a == "-b") { bcf = default_bcf; }
             else if (a == "--parsedump") { parsedump = true; }
             else if (a == "--disasm")    { disasm = true; }
+            else if (a == "--no-cache")  { usecache = false; }
+            else if (a == "--time-passes") { timepasses = true; }
             else if (a == "--verbose")   { min_output_level = OUTPUT_INFO; }
             else if (a == "--debug")     { min_output_level = OUTPUT_DEBUG; }
             else if (a == "--silent")    { min_output_level = OUTPUT_ERROR; }
@@ -164,19 +240,35 @@ int main(int argc, char* argv[])
         }
         else
         {
-            Output(OUTPUT_INFO, "compiling...");
-
-            string dump;
-            Compile(StripDirPart(fn).c_str(), nullptr, bytecode, parsedump ? &dump : nullptr);
+            auto cachefn = StripDirPart(fn) + ".lbcache";
+            if (parsedump || timepasses) usecache = false;  // These need an actual compile.
 
-            if (parsedump)
+            if (usecache && LoadCache(cachefn.c_str(), bytecode))
+            {
+                Output(OUTPUT_INFO, "using cached bytecode: %s", cachefn.c_str());
+            }
+            else
             {
-                FILE *f = OpenForWriting("parsedump.txt", false);
-                if (f)
+                Output(OUTPUT_INFO, "compiling...");
+
+                string dump, passreport;
+                vector<string> filenames;
+                Compile(StripDirPart(fn).c_str(), nullptr, bytecode, parsedump ? &dump : nullptr, &filenames,
+                        timepasses ? &passreport : nullptr);
+
+                if (timepasses) Output(OUTPUT_PROGRAM, "%s", passreport.c_str());
+
+                if (parsedump)
                 {
-                    fprintf(f, "%s\n", dump.c_str());
-                    fclose(f);
+                    FILE *f = OpenForWriting("parsedump.txt", false);
+                    if (f)
+                    {
+                        fprintf(f, "%s\n", dump.c_str());
+                        fclose(f);
+                    }
                 }
+
+                if (usecache) SaveCache(cachefn.c_str(), filenames, bytecode);
             }
 
             if (bcf)
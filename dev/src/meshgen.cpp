@@ -1004,13 +1004,17 @@ int polygonize_mc(ImplicitFunction *root, const int targetgridsize, vector<float
         int octaves = 8;
         float persistence = 0.5f;
 
-        for (auto &v : verts)
+        ParallelFor(verts.size(), 1024, [&](size_t begin, size_t end)
         {
-            auto n = float3(simplexNoise(octaves, persistence, scale, float4(v.pos, 0.0f / scale)),
-                            simplexNoise(octaves, persistence, scale, float4(v.pos, 0.3f / scale)),
-                            simplexNoise(octaves, persistence, scale, float4(v.pos, 0.6f / scale)));
-            v.col = quantizec(color2vec(v.col).xyz() * (float3_1 - (n + float3_1) / 2 * noiseintensity));
-        }
+            for (auto i = begin; i < end; i++)
+            {
+                auto &v = verts[i];
+                auto n = float3(simplexNoise(octaves, persistence, scale, float4(v.pos, 0.0f / scale)),
+                                simplexNoise(octaves, persistence, scale, float4(v.pos, 0.3f / scale)),
+                                simplexNoise(octaves, persistence, scale, float4(v.pos, 0.6f / scale)));
+                v.col = quantizec(color2vec(v.col).xyz() * (float3_1 - (n + float3_1) / 2 * noiseintensity));
+            }
+        });
     }
 
     /////////// MODULATE LIGHTING BY CREASE FACTOR
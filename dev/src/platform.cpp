@@ -16,6 +16,7 @@
 
 #include "stdafx.h"
 #include <stdarg.h>
+#include <sys/stat.h>
 
 #ifdef _WIN32
     #define VC_EXTRALEAN
@@ -136,9 +137,37 @@ uchar *LoadFile(const char *relfilename, size_t *lenret)
     return LoadFilePlatform((writedir + srfn).c_str(), lenret);
 }
 
-FILE *OpenForWriting(const char *relfilename, bool binary)
+FILE *OpenForWriting(const char *relfilename, bool binary, bool append)
 {
-    return fopen((writedir + SanitizePath(relfilename)).c_str(), binary ? "wb" : "w");
+    return fopen((writedir + SanitizePath(relfilename)).c_str(), append ? (binary ? "ab" : "a") : (binary ? "wb" : "w"));
+}
+
+// Searches the same folders as LoadFile, but only sees plain files (not e.g. Android assets).
+FILE *OpenForReading(const char *relfilename)
+{
+    auto srfn = SanitizePath(relfilename);
+    auto f = fopen((datadir + srfn).c_str(), "rb");
+    if (f) return f;
+    f = fopen((auxdir + srfn).c_str(), "rb");
+    if (f) return f;
+    return fopen((writedir + srfn).c_str(), "rb");
+}
+
+// Finds a folder to scan: first in the write folder, where files made with write_file end up, then in the
+// same folders OpenForReading searches. Returns the full path, or "" if not found.
+string FindFolder(const char *relfoldername)
+{
+    auto srfn = SanitizePath(relfoldername);
+    for (auto base : { &writedir, &datadir, &auxdir })
+    {
+        auto path = *base + srfn;
+        if (path.empty()) path = ".";
+        // Windows' stat doesn't accept a trailing separator.
+        if (path.size() > 1 && path.back() == FILESEP) path.pop_back();
+        struct stat st;
+        if (!stat(path.c_str(), &st) && (st.st_mode & S_IFDIR)) return path;
+    }
+    return "";
 }
 
 OutputType min_output_level = OUTPUT_WARN;
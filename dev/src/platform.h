@@ -21,7 +21,9 @@ extern string StripDirPart(const char *filepath);
 extern bool SetupDefaultDirs(const char *exefilepath, const char *auxfilepath, bool from_bundle);
 
 extern uchar *LoadFile(const char *relfilename, size_t *len = nullptr);
-extern FILE *OpenForWriting(const char *relfilename, bool binary);
+extern FILE *OpenForWriting(const char *relfilename, bool binary, bool append = false);
+extern FILE *OpenForReading(const char *relfilename);
+extern string FindFolder(const char *relfoldername);
 extern string SanitizePath(const char *path);
 
 // logging:
@@ -57,3 +59,11 @@ extern void ConditionalBreakpoint(bool shouldbreak);
 #if defined(__IOS__) || defined(__ANDROID__)
     #define PLATFORM_TOUCH
 #endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define PLATFORM_SSE2
+#endif
+
+#ifndef __EMSCRIPTEN__
+    #define PLATFORM_THREADS
+#endif
@@ -3,6 +3,10 @@
 #include "vmdata.h"
 #include "natreg.h"
 
+#ifdef PLATFORM_SSE2
+    #include <emmintrin.h>
+#endif
+
 using namespace lobster;
 
 
@@ -387,61 +391,258 @@ float simplexRawNoise( const float x, const float y, const float z, const float
 }
 
 
-// 2D Multi-octave Simplex noise.
-//
-// For each octave, a higher frequency/lower amplitude function will be added to the original.
-// The higher the persistence [0-1], the more of each succeeding octave will be added.
-float simplexNoise( const int octaves, const float persistence, const float scale, const float2 &v ) {
-    float total = 0;
-    float frequency = scale;
-    float amplitude = 1;
+#ifdef PLATFORM_SSE2
 
-    // We have to keep track of the largest possible amplitude,
-    // because each octave adds more, and we need a value in [-1, 1].
-    float maxAmplitude = 0;
+// SSE2 versions of the above, that compute 4 noise values at once. They give exactly the same results: all math is
+// done in the same order, and the simplex corners are ordered by counting how many coordinates each one is larger
+// than, which is equivalent to the branches and the lookup table above. SSE2 has no gathers, so the permutation and
+// gradient lookups are done for each lane in turn.
+
+struct Lanes
+{
+    int v[4];
+    Lanes(__m128i m) { _mm_storeu_si128((__m128i *)v, m); }
+    int operator[](int i) const { return v[i]; }
+};
+
+// Same as fastfloor, including it rounding integers <= 0 down by one.
+static inline __m128i fastfloor4(__m128 x)
+{
+    return _mm_add_epi32(_mm_cvttps_epi32(x), _mm_castps_si128(_mm_cmple_ps(x, _mm_setzero_ps())));
+}
+
+static inline __m128 tofloat4(__m128i i) { return _mm_cvtepi32_ps(i); }
+
+// Corner offset of 1 (as float) where rank > threshold.
+static inline __m128 offset4(__m128i rank, int threshold)
+{
+    return _mm_and_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(rank, _mm_set1_epi32(threshold))), _mm_set1_ps(1.0f));
+}
+
+static inline __m128 sub4(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+static inline __m128 add4(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+static inline __m128 mul4(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+static inline __m128 set4(float f) { return _mm_set1_ps(f); }
+
+static inline __m128 gradient4(const int *const g[4], int c)
+{
+    return _mm_setr_ps((float)g[0][c], (float)g[1][c], (float)g[2][c], (float)g[3][c]);
+}
+
+static inline __m128 dot4(const int *const g[4], __m128 x, __m128 y)
+{
+    return add4(mul4(gradient4(g, 0), x), mul4(gradient4(g, 1), y));
+}
+
+static inline __m128 dot4(const int *const g[4], __m128 x, __m128 y, __m128 z)
+{
+    return add4(dot4(g, x, y), mul4(gradient4(g, 2), z));
+}
 
-    for( int i=0; i < octaves; i++ ) {
-        total += simplexRawNoise( v.x() * frequency, v.y() * frequency ) * amplitude;
+static inline __m128 dot4(const int *const g[4], __m128 x, __m128 y, __m128 z, __m128 w)
+{
+    return add4(dot4(g, x, y, z), mul4(gradient4(g, 3), w));
+}
+
+// The contribution of one corner, given its falloff t and gradient dot product.
+static inline __m128 contribution4(__m128 t, __m128 d)
+{
+    auto used = _mm_cmpnlt_ps(t, _mm_setzero_ps());
+    t = mul4(t, t);
+    return _mm_and_ps(used, mul4(mul4(t, t), d));
+}
 
-        frequency *= 2;
-        maxAmplitude += amplitude;
-        amplitude *= persistence;
+static __m128 simplexRawNoise4( __m128 x, __m128 y ) {
+    const float F2 = 0.5f * (sqrtf(3.0f) - 1.0f);
+    const float G2 = (3.0f - sqrtf(3.0f)) / 6.0f;
+
+    auto s = mul4(add4(x, y), set4(F2));
+    auto i = fastfloor4(add4(x, s));
+    auto j = fastfloor4(add4(y, s));
+    auto t = mul4(tofloat4(_mm_add_epi32(i, j)), set4(G2));
+    auto x0 = sub4(x, sub4(tofloat4(i), t));
+    auto y0 = sub4(y, sub4(tofloat4(j), t));
+
+    // Lower triangle if x0 > y0.
+    auto lower = _mm_castps_si128(_mm_cmpgt_ps(x0, y0));
+    auto i1 = _mm_and_si128(lower, _mm_set1_epi32(1));
+    auto j1 = _mm_sub_epi32(_mm_set1_epi32(1), i1);
+    auto x1 = add4(sub4(x0, tofloat4(i1)), set4(G2));
+    auto y1 = add4(sub4(y0, tofloat4(j1)), set4(G2));
+    auto x2 = add4(sub4(x0, set4(1.0f)), set4(2.0f * G2));
+    auto y2 = add4(sub4(y0, set4(1.0f)), set4(2.0f * G2));
+
+    Lanes ii(_mm_and_si128(i, _mm_set1_epi32(255))), jj(_mm_and_si128(j, _mm_set1_epi32(255)));
+    Lanes li1(i1), lj1(j1);
+    const int *g0[4], *g1[4], *g2[4];
+    for (int l = 0; l < 4; l++) {
+        g0[l] = grad3[perm[ii[l]+perm[jj[l]]] % 12];
+        g1[l] = grad3[perm[ii[l]+li1[l]+perm[jj[l]+lj1[l]]] % 12];
+        g2[l] = grad3[perm[ii[l]+1+perm[jj[l]+1]] % 12];
     }
 
-    return total / maxAmplitude;
+    auto half = set4(0.5f);
+    auto n0 = contribution4(sub4(sub4(half, mul4(x0, x0)), mul4(y0, y0)), dot4(g0, x0, y0));
+    auto n1 = contribution4(sub4(sub4(half, mul4(x1, x1)), mul4(y1, y1)), dot4(g1, x1, y1));
+    auto n2 = contribution4(sub4(sub4(half, mul4(x2, x2)), mul4(y2, y2)), dot4(g2, x2, y2));
+    return mul4(set4(70.0f), add4(add4(n0, n1), n2));
 }
 
+static __m128 simplexRawNoise4( __m128 x, __m128 y, __m128 z ) {
+    const float F3 = 1.0f/3.0f;
+    const float G3 = 1.0f/6.0f;
+
+    auto s = mul4(add4(add4(x, y), z), set4(F3));
+    auto i = fastfloor4(add4(x, s));
+    auto j = fastfloor4(add4(y, s));
+    auto k = fastfloor4(add4(z, s));
+    auto t = mul4(tofloat4(_mm_add_epi32(_mm_add_epi32(i, j), k)), set4(G3));
+    auto x0 = sub4(x, sub4(tofloat4(i), t));
+    auto y0 = sub4(y, sub4(tofloat4(j), t));
+    auto z0 = sub4(z, sub4(tofloat4(k), t));
+
+    // Comparisons as masks of -1, ranks count how many coordinates each is >= to (ties as in the branches above).
+    auto xy = _mm_castps_si128(_mm_cmpge_ps(x0, y0));
+    auto yz = _mm_castps_si128(_mm_cmpge_ps(y0, z0));
+    auto xz = _mm_castps_si128(_mm_cmpge_ps(x0, z0));
+    auto one = _mm_set1_epi32(1);
+    auto rankx = _mm_sub_epi32(_mm_setzero_si128(), _mm_add_epi32(xy, xz));
+    auto ranky = _mm_sub_epi32(_mm_add_epi32(one, xy), yz);
+    auto rankz = _mm_add_epi32(_mm_add_epi32(one, one), _mm_add_epi32(yz, xz));
+
+    auto i1 = offset4(rankx, 1), j1 = offset4(ranky, 1), k1 = offset4(rankz, 1);
+    auto i2 = offset4(rankx, 0), j2 = offset4(ranky, 0), k2 = offset4(rankz, 0);
+    auto x1 = add4(sub4(x0, i1), set4(G3));
+    auto y1 = add4(sub4(y0, j1), set4(G3));
+    auto z1 = add4(sub4(z0, k1), set4(G3));
+    auto x2 = add4(sub4(x0, i2), set4(2.0f*G3));
+    auto y2 = add4(sub4(y0, j2), set4(2.0f*G3));
+    auto z2 = add4(sub4(z0, k2), set4(2.0f*G3));
+    auto x3 = add4(sub4(x0, set4(1.0f)), set4(3.0f*G3));
+    auto y3 = add4(sub4(y0, set4(1.0f)), set4(3.0f*G3));
+    auto z3 = add4(sub4(z0, set4(1.0f)), set4(3.0f*G3));
+
+    auto m255 = _mm_set1_epi32(255);
+    Lanes ii(_mm_and_si128(i, m255)), jj(_mm_and_si128(j, m255)), kk(_mm_and_si128(k, m255));
+    Lanes ri(rankx), rj(ranky), rk(rankz);
+    const int *g0[4], *g1[4], *g2[4], *g3[4];
+    for (int l = 0; l < 4; l++) {
+        int i1 = ri[l]>=2, j1 = rj[l]>=2, k1 = rk[l]>=2;
+        int i2 = ri[l]>=1, j2 = rj[l]>=1, k2 = rk[l]>=1;
+        g0[l] = grad3[perm[ii[l]+perm[jj[l]+perm[kk[l]]]] % 12];
+        g1[l] = grad3[perm[ii[l]+i1+perm[jj[l]+j1+perm[kk[l]+k1]]] % 12];
+        g2[l] = grad3[perm[ii[l]+i2+perm[jj[l]+j2+perm[kk[l]+k2]]] % 12];
+        g3[l] = grad3[perm[ii[l]+1+perm[jj[l]+1+perm[kk[l]+1]]] % 12];
+    }
 
-// 3D Multi-octave Simplex noise.
-//
-// For each octave, a higher frequency/lower amplitude function will be added to the original.
-// The higher the persistence [0-1], the more of each succeeding octave will be added.
-float simplexNoise( const int octaves, const float persistence, const float scale, const float3 &v ) {
-    float total = 0;
-    float frequency = scale;
-    float amplitude = 1;
+    auto r = set4(0.6f);
+    auto n0 = contribution4(sub4(sub4(sub4(r, mul4(x0, x0)), mul4(y0, y0)), mul4(z0, z0)), dot4(g0, x0, y0, z0));
+    auto n1 = contribution4(sub4(sub4(sub4(r, mul4(x1, x1)), mul4(y1, y1)), mul4(z1, z1)), dot4(g1, x1, y1, z1));
+    auto n2 = contribution4(sub4(sub4(sub4(r, mul4(x2, x2)), mul4(y2, y2)), mul4(z2, z2)), dot4(g2, x2, y2, z2));
+    auto n3 = contribution4(sub4(sub4(sub4(r, mul4(x3, x3)), mul4(y3, y3)), mul4(z3, z3)), dot4(g3, x3, y3, z3));
+    return mul4(set4(32.0f), add4(add4(add4(n0, n1), n2), n3));
+}
 
-    // We have to keep track of the largest possible amplitude,
-    // because each octave adds more, and we need a value in [-1, 1].
-    float maxAmplitude = 0;
+static __m128 simplexRawNoise4( __m128 x, __m128 y, __m128 z, __m128 w ) {
+    const float F4 = (sqrtf(5.0f)-1.0f)/4.0f;
+    const float G4 = (5.0f-sqrtf(5.0f))/20.0f;
+
+    auto s = mul4(add4(add4(add4(x, y), z), w), set4(F4));
+    auto i = fastfloor4(add4(x, s));
+    auto j = fastfloor4(add4(y, s));
+    auto k = fastfloor4(add4(z, s));
+    auto l = fastfloor4(add4(w, s));
+    auto t = mul4(tofloat4(_mm_add_epi32(_mm_add_epi32(_mm_add_epi32(i, j), k), l)), set4(G4));
+    auto x0 = sub4(x, sub4(tofloat4(i), t));
+    auto y0 = sub4(y, sub4(tofloat4(j), t));
+    auto z0 = sub4(z, sub4(tofloat4(k), t));
+    auto w0 = sub4(w, sub4(tofloat4(l), t));
+
+    // Ranks count how many coordinates each is larger than, giving the same values as the simplex table.
+    auto xy = _mm_castps_si128(_mm_cmpgt_ps(x0, y0));
+    auto xz = _mm_castps_si128(_mm_cmpgt_ps(x0, z0));
+    auto yz = _mm_castps_si128(_mm_cmpgt_ps(y0, z0));
+    auto xw = _mm_castps_si128(_mm_cmpgt_ps(x0, w0));
+    auto yw = _mm_castps_si128(_mm_cmpgt_ps(y0, w0));
+    auto zw = _mm_castps_si128(_mm_cmpgt_ps(z0, w0));
+    auto one = _mm_set1_epi32(1);
+    auto rankx = _mm_sub_epi32(_mm_setzero_si128(), _mm_add_epi32(_mm_add_epi32(xy, xz), xw));
+    auto ranky = _mm_sub_epi32(_mm_sub_epi32(_mm_add_epi32(one, xy), yz), yw);
+    auto rankz = _mm_sub_epi32(_mm_add_epi32(_mm_add_epi32(one, one), _mm_add_epi32(xz, yz)), zw);
+    auto rankw = _mm_add_epi32(_mm_set1_epi32(3), _mm_add_epi32(_mm_add_epi32(xw, yw), zw));
+
+    auto x1 = add4(sub4(x0, offset4(rankx, 2)), set4(G4));
+    auto y1 = add4(sub4(y0, offset4(ranky, 2)), set4(G4));
+    auto z1 = add4(sub4(z0, offset4(rankz, 2)), set4(G4));
+    auto w1 = add4(sub4(w0, offset4(rankw, 2)), set4(G4));
+    auto x2 = add4(sub4(x0, offset4(rankx, 1)), set4(2.0f*G4));
+    auto y2 = add4(sub4(y0, offset4(ranky, 1)), set4(2.0f*G4));
+    auto z2 = add4(sub4(z0, offset4(rankz, 1)), set4(2.0f*G4));
+    auto w2 = add4(sub4(w0, offset4(rankw, 1)), set4(2.0f*G4));
+    auto x3 = add4(sub4(x0, offset4(rankx, 0)), set4(3.0f*G4));
+    auto y3 = add4(sub4(y0, offset4(ranky, 0)), set4(3.0f*G4));
+    auto z3 = add4(sub4(z0, offset4(rankz, 0)), set4(3.0f*G4));
+    auto w3 = add4(sub4(w0, offset4(rankw, 0)), set4(3.0f*G4));
+    auto x4 = add4(sub4(x0, set4(1.0f)), set4(4.0f*G4));
+    auto y4 = add4(sub4(y0, set4(1.0f)), set4(4.0f*G4));
+    auto z4 = add4(sub4(z0, set4(1.0f)), set4(4.0f*G4));
+    auto w4 = add4(sub4(w0, set4(1.0f)), set4(4.0f*G4));
+
+    auto m255 = _mm_set1_epi32(255);
+    Lanes ii(_mm_and_si128(i, m255)), jj(_mm_and_si128(j, m255)), kk(_mm_and_si128(k, m255)),
+          ll(_mm_and_si128(l, m255));
+    Lanes ri(rankx), rj(ranky), rk(rankz), rl(rankw);
+    const int *g0[4], *g1[4], *g2[4], *g3[4], *g4[4];
+    for (int n = 0; n < 4; n++) {
+        int i1 = ri[n]>=3, j1 = rj[n]>=3, k1 = rk[n]>=3, l1 = rl[n]>=3;
+        int i2 = ri[n]>=2, j2 = rj[n]>=2, k2 = rk[n]>=2, l2 = rl[n]>=2;
+        int i3 = ri[n]>=1, j3 = rj[n]>=1, k3 = rk[n]>=1, l3 = rl[n]>=1;
+        g0[n] = grad4[perm[ii[n]+perm[jj[n]+perm[kk[n]+perm[ll[n]]]]] % 32];
+        g1[n] = grad4[perm[ii[n]+i1+perm[jj[n]+j1+perm[kk[n]+k1+perm[ll[n]+l1]]]] % 32];
+        g2[n] = grad4[perm[ii[n]+i2+perm[jj[n]+j2+perm[kk[n]+k2+perm[ll[n]+l2]]]] % 32];
+        g3[n] = grad4[perm[ii[n]+i3+perm[jj[n]+j3+perm[kk[n]+k3+perm[ll[n]+l3]]]] % 32];
+        g4[n] = grad4[perm[ii[n]+1+perm[jj[n]+1+perm[kk[n]+1+perm[ll[n]+1]]]] % 32];
+    }
 
-    for( int i=0; i < octaves; i++ ) {
-        total += simplexRawNoise( v.x() * frequency, v.y() * frequency, v.z() * frequency ) * amplitude;
+    auto r = set4(0.6f);
+    #define FALLOFF4(x, y, z, w) sub4(sub4(sub4(sub4(r, mul4(x, x)), mul4(y, y)), mul4(z, z)), mul4(w, w))
+    auto n0 = contribution4(FALLOFF4(x0, y0, z0, w0), dot4(g0, x0, y0, z0, w0));
+    auto n1 = contribution4(FALLOFF4(x1, y1, z1, w1), dot4(g1, x1, y1, z1, w1));
+    auto n2 = contribution4(FALLOFF4(x2, y2, z2, w2), dot4(g2, x2, y2, z2, w2));
+    auto n3 = contribution4(FALLOFF4(x3, y3, z3, w3), dot4(g3, x3, y3, z3, w3));
+    auto n4 = contribution4(FALLOFF4(x4, y4, z4, w4), dot4(g4, x4, y4, z4, w4));
+    #undef FALLOFF4
+    return mul4(set4(27.0f), add4(add4(add4(add4(n0, n1), n2), n3), n4));
+}
 
-        frequency *= 2;
-        maxAmplitude += amplitude;
-        amplitude *= persistence;
+static __m128 simplexRawNoise4( const __m128 *c, int dims ) {
+    switch (dims) {
+        case 2:  return simplexRawNoise4(c[0], c[1]);
+        case 3:  return simplexRawNoise4(c[0], c[1], c[2]);
+        default: return simplexRawNoise4(c[0], c[1], c[2], c[3]);
     }
+}
 
-    return total / maxAmplitude;
+#else
+
+static float simplexRawNoise( const float *c, int dims ) {
+    switch (dims) {
+        case 2:  return simplexRawNoise(c[0], c[1]);
+        case 3:  return simplexRawNoise(c[0], c[1], c[2]);
+        default: return simplexRawNoise(c[0], c[1], c[2], c[3]);
+    }
 }
 
+#endif
 
-// 4D Multi-octave Simplex noise.
+
+// Multi-octave Simplex noise, in 2D, 3D or 4D (dims).
 //
 // For each octave, a higher frequency/lower amplitude function will be added to the original.
 // The higher the persistence [0-1], the more of each succeeding octave will be added.
-float simplexNoise( const int octaves, const float persistence, const float scale, const float4 &v ) {
+// With SSE2, up to 4 octaves are computed at once, then added up in order like the scalar loop.
+static float simplexNoise( const int octaves, const float persistence, const float scale, const float *v,
+                           int dims ) {
     float total = 0;
     float frequency = scale;
     float amplitude = 1;
@@ -450,21 +651,127 @@ float simplexNoise( const int octaves, const float persistence, const float scal
     // because each octave adds more, and we need a value in [-1, 1].
     float maxAmplitude = 0;
 
-    for( int i=0; i < octaves; i++ ) {
-        total += simplexRawNoise( v.x() * frequency, v.y() * frequency, v.z() * frequency, v.w() * frequency ) *
-                 amplitude;
-
-        frequency *= 2;
-        maxAmplitude += amplitude;
-        amplitude *= persistence;
-    }
+    #ifdef PLATFORM_SSE2
+        for( int i=0; i < octaves; i += 4 ) {
+            float c[4][4];
+            for( int o=0; o < 4; o++ ) {
+                for( int d=0; d < dims; d++ ) c[d][o] = v[d] * frequency;
+                frequency *= 2;
+            }
+            __m128 cv[4];
+            for( int d=0; d < dims; d++ ) cv[d] = _mm_loadu_ps(c[d]);
+            float raw[4];
+            _mm_storeu_ps(raw, simplexRawNoise4(cv, dims));
+            for( int o=0; o < min(4, octaves - i); o++ ) {
+                total += raw[o] * amplitude;
+                maxAmplitude += amplitude;
+                amplitude *= persistence;
+            }
+        }
+    #else
+        for( int i=0; i < octaves; i++ ) {
+            float c[4];
+            for( int d=0; d < dims; d++ ) c[d] = v[d] * frequency;
+            total += simplexRawNoise( c, dims ) * amplitude;
+
+            frequency *= 2;
+            maxAmplitude += amplitude;
+            amplitude *= persistence;
+        }
+    #endif
 
     return total / maxAmplitude;
 }
 
+float simplexNoise( const int octaves, const float persistence, const float scale, const float2 &v ) {
+    return simplexNoise(octaves, persistence, scale, v.begin(), 2);
+}
+
+float simplexNoise( const int octaves, const float persistence, const float scale, const float3 &v ) {
+    return simplexNoise(octaves, persistence, scale, v.begin(), 3);
+}
+
+float simplexNoise( const int octaves, const float persistence, const float scale, const float4 &v ) {
+    return simplexNoise(octaves, persistence, scale, v.begin(), 4);
+}
+
+// Multi-octave noise for a row of n points, with coordinates origin + (x, 0, 0, 0) for x in [0..n).
+// With SSE2, computes 4 points at once, giving the same results as simplexNoise for each point.
+static void simplexNoiseRow( const int octaves, const float persistence, const float scale, const float4 &origin,
+                             int dims, float *out, int n ) {
+    int x = 0;
+    #ifdef PLATFORM_SSE2
+        for( ; x < n; x += 4 ) {
+            __m128 p[4];
+            p[0] = add4(set4(origin.x()), tofloat4(_mm_add_epi32(_mm_set1_epi32(x), _mm_setr_epi32(0, 1, 2, 3))));
+            for( int d=1; d < dims; d++ ) p[d] = set4(origin[d]);
+            auto total = _mm_setzero_ps();
+            float frequency = scale;
+            float amplitude = 1;
+            float maxAmplitude = 0;
+            for( int i=0; i < octaves; i++ ) {
+                __m128 c[4];
+                for( int d=0; d < dims; d++ ) c[d] = mul4(p[d], set4(frequency));
+                total = add4(total, mul4(simplexRawNoise4(c, dims), set4(amplitude)));
+                frequency *= 2;
+                maxAmplitude += amplitude;
+                amplitude *= persistence;
+            }
+            total = _mm_div_ps(total, set4(maxAmplitude));
+            if (x + 4 <= n) {
+                _mm_storeu_ps(out + x, total);
+            } else {
+                float rest[4];
+                _mm_storeu_ps(rest, total);
+                for( int i=x; i < n; i++ ) out[i] = rest[i - x];
+            }
+        }
+    #else
+        for( ; x < n; x++ ) {
+            auto p = origin;
+            p.add(0, (float)x);
+            out[x] = simplexNoise(octaves, persistence, scale, p.begin(), dims);
+        }
+    #endif
+}
+
+// Fills out with size.x * size.y * size.z noise values (x varying fastest), for the points origin + (x, y, z, 0).
+// Rows are spread over threads.
+void simplexNoiseGrid( const int octaves, const float persistence, const float scale, const float4 &origin,
+                       int dims, const int3 &size, float *out ) {
+    // Aim for at least ~64K noise evaluations per thread.
+    auto rowcost = (size_t)max(1, size.x() * octaves);
+    ParallelFor(size.y() * size.z(), 65536 / rowcost + 1, [&](size_t begin, size_t end) {
+        for( auto row = begin; row < end; row++ ) {
+            auto p = origin;
+            p.add(1, float((int)row % size.y()));
+            p.add(2, float((int)row / size.y()));
+            simplexNoiseRow(octaves, persistence, scale, p, dims, out + row * size.x(), size.x());
+        }
+    });
+}
+
 //simplexNoise(octaves, 0.7f, 1.0f, x, y, z);
 
 
+// Checks the size & offset arguments of the noise grid builtins, and returns the number of noise dimensions:
+// that of size or offset, whichever is larger.
+int NoiseGridArgs(const char *name, Value &size, Value &offset, int3 &isize, float4 &origin)
+{
+    int dims = max(size.eval()->Len(), offset.True() ? offset.eval()->Len() : 0);
+    if (size.eval()->Len() < 2 || size.eval()->Len() > 3)
+    {
+        size.DECRT();
+        offset.DECRTNIL();
+        g_vm->BuiltinError(string(name) + ": size must have 2 or 3 components");
+    }
+    isize = ValueDecToI<3>(size, 1);
+    origin = offset.True() ? ValueDecToF<4>(offset) : float4_0;
+    if (!(isize > int3(0))) g_vm->BuiltinError(string(name) + ": size must be positive");
+    if ((int64_t)isize.x() * isize.y() * isize.z() > INT_MAX) g_vm->BuiltinError(string(name) + ": size too large");
+    return min(dims, 4);
+}
+
 void AddNoise()
 {
     STARTDECL(simplex) (Value &pos, Value &octaves, Value &scale, Value &persistence)
@@ -476,6 +783,23 @@ void AddNoise()
     ENDDECL4(simplex, "pos,octaves,scale,persistence", "F]IFF", "F",
         "returns a simplex noise value [-1..1] given a 2D/3D or 4D location, the number of octaves (try 8),"
         " a scale (try 1), and persistence from one octave to the next (try 0.5)");
+
+    STARTDECL(simplex_grid) (Value &size, Value &octaves, Value &scale, Value &persistence, Value &offset)
+    {
+        int3 isize;
+        float4 origin;
+        auto dims = NoiseGridArgs("simplex_grid", size, offset, isize, origin);
+        auto n = isize.x() * isize.y() * isize.z();
+        vector<float> grid(n);
+        simplexNoiseGrid(octaves.ival(), persistence.fval(), scale.fval(), origin, dims, isize, grid.data());
+        auto v = (LVector *)g_vm->NewVector(n, n, g_vm->GetTypeInfo(TYPE_ELEM_VECTOR_OF_FLOAT));
+        for (int i = 0; i < n; i++) v->At(i) = Value(grid[i]);
+        return Value(v);
+    }
+    ENDDECL5(simplex_grid, "size,octaves,scale,persistence,offset", "I]IFFF]?", "F]",
+        "returns simplex noise values for a whole 2D or 3D grid of the given size at once, in a single vector"
+        " (x varying fastest). the values are the same as simplex() at position offset + [x, y, z], but much faster"
+        " to compute. offset may have more components than size, e.g. 2D slices of 3D/4D noise.");
 }
 
 AutoRegister __an("noise", AddNoise);
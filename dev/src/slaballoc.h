@@ -107,6 +107,7 @@ class SlabAlloc
     long long stats[MAXBUCKETS];
     #endif
     long long statbig;
+    size_t bigbytes, bigbytespeak;
 
     void putinbuckets(char *start, char *end, int b, int size)
     {
@@ -174,7 +175,7 @@ class SlabAlloc
 
     public:
 
-    SlabAlloc() : blocks(nullptr), statbig(0)
+    SlabAlloc() : blocks(nullptr), statbig(0), bigbytes(0), bigbytespeak(0)
     {
         for (int i = 0; i<MAXBUCKETS; i++)
         {
@@ -257,13 +258,15 @@ class SlabAlloc
 
     void *alloc(size_t size)
     {
-        return size > MAXREUSESIZE ? alloc_large(size)
-                                   : alloc_small(size);
+        if (size <= MAXREUSESIZE) return alloc_small(size);
+        bigbytes += size;
+        bigbytespeak = max(bigbytespeak, bigbytes);
+        return alloc_large(size);
     }
 
     void dealloc(void *p, size_t size)
     {
-        if (size > MAXREUSESIZE) dealloc_large(p);
+        if (size > MAXREUSESIZE) { bigbytes -= size; dealloc_large(p); }
         else                     dealloc_small(p);
     }
 
@@ -383,6 +386,15 @@ class SlabAlloc
         return sum;
     }
 
+    // Pages are never returned to the OS before destruction, so this is also the peak. Large allocations are
+    // only accounted for when made thru alloc() (which knows their size).
+    size_t peak_memory_usage()
+    {
+        size_t sum = bigbytespeak;
+        for (auto b = blocks; b; b = (void **)*b) sum += PAGEBLOCKSIZE;
+        return sum;
+    }
+
     bool pointer_is_in_allocator(void *p)
     {
         for (auto b = blocks; b; b = (void **)*b)
@@ -20,6 +20,7 @@
     #define _CRTDBG_MAP_ALLOC
     #include <stdlib.h>
     #include <crtdbg.h>
+    #include <intrin.h>
     #ifdef _DEBUG
         #define DEBUG_NEW new(_NORMAL_BLOCK, __FILE__, __LINE__)
         #define new DEBUG_NEW
@@ -33,15 +34,18 @@
 #include <string.h>
 #include <stdint.h>
 #include <float.h>
+#include <limits.h>
 
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <list>
 #include <set>
 #include <algorithm>
 #include <iterator>
 #include <functional>
+#include <thread>
 
 #include <sstream>
 #include <iostream>
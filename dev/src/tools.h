@@ -201,19 +201,66 @@ class PCG32
     public:
 
     PCG32() : state(0xABADCAFEDEADBEEF), inc(0xDEADBABEABADD00D) {}
+    PCG32(uint64_t _state, uint64_t _inc) : state(_state), inc(_inc) {}
+
+    uint64_t State() const { return state; }
+    uint64_t Inc() const { return inc; }
+
+    // Calculate output function (XSH RR)
+    static uint32_t Output(uint64_t oldstate)
+    {
+        uint32_t xorshifted = uint32_t(((oldstate >> 18u) ^ oldstate) >> 27u);
+        uint32_t rot = oldstate >> 59u;
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
 
     uint32_t Random()
     {
         uint64_t oldstate = state;
         // Advance internal state
         state = oldstate * 6364136223846793005ULL + (inc | 1);
-        // Calculate output function (XSH RR), uses old state for max ILP
-        uint32_t xorshifted = uint32_t(((oldstate >> 18u) ^ oldstate) >> 27u);
-        uint32_t rot = oldstate >> 59u;
-        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+        // Uses old state for max ILP
+        return Output(oldstate);
+    }
+
+    // Gives the same results as calling Random() n times, passing them to f(i, r). Runs 4 copies of the generator
+    // that each jump 4 steps ahead at once, so their multiplies don't have to wait on each other.
+    template<typename F> void Generate(size_t n, const F &f)
+    {
+        const uint64_t mul = 6364136223846793005ULL, add = inc | 1;
+        const uint64_t mul2 = mul * mul, add2 = add * (mul + 1);
+        const uint64_t mul4 = mul2 * mul2, add4 = add2 * (mul2 + 1);
+        size_t i = 0;
+        if (n >= 4)
+        {
+            uint64_t s0 = state, s1 = s0 * mul + add, s2 = s0 * mul2 + add2, s3 = s1 * mul2 + add2;
+            for (; i + 4 <= n; i += 4)
+            {
+                f(i, Output(s0));
+                f(i + 1, Output(s1));
+                f(i + 2, Output(s2));
+                f(i + 3, Output(s3));
+                s0 = s0 * mul4 + add4;
+                s1 = s1 * mul4 + add4;
+                s2 = s2 * mul4 + add4;
+                s3 = s3 * mul4 + add4;
+            }
+            state = s0;
+        }
+        for (; i < n; i++) f(i, Random());
     }
 
     void ReSeed(uint32_t s) { state = s; inc = 0xDEADBABEABADD00D; }
+
+    // Seeding as recommended by pcg-random.org: each seq gives an independent stream.
+    void Seed(uint64_t seed, uint64_t seq)
+    {
+        state = 0;
+        inc = (seq << 1) | 1;
+        Random();
+        state += seed;
+        Random();
+    }
 };
 
 template<typename T> struct RandomNumberGenerator
@@ -229,33 +276,61 @@ template<typename T> struct RandomNumberGenerator
     float rndfloatsigned() { return (float)(rnddouble() * 2 - 1); }
 };
 
-// Special case for to_string to get exact float formatting we need.
-template<typename T> string to_string_float(T x, int decimals = -1)
+// Appends i in decimal, like to_string() without the temporary.
+inline void append_int(string &sd, int i)
 {
-    // stringstream gives more consistent cross-platform results than to_string() for floats, and can
-    // at least be configured to turn scientific notation off.
-    std::stringstream ss;
-    // Suppress scientific notation.
-    ss << std::fixed;
+    char buf[12];
+    auto end = buf + sizeof(buf);
+    auto d = end;
+    auto u = i < 0 ? 0u - (uint)i : (uint)i;
+    do { *--d = (char)('0' + u % 10); u /= 10; } while (u);
+    if (i < 0) *--d = '-';
+    sd.append(d, end);
+}
+
+// Appends x with the exact float formatting we need (see to_string_float).
+template<typename T> void append_float(string &sd, T x, int decimals = -1)
+{
+    // "%f" is what stringstream uses for std::fixed, which gives more consistent cross-platform results than
+    // to_string() for floats, and turns scientific notation off.
     // There's no way to tell it to just output however many decimals are actually significant, sigh.
-    // Once you turn on fixed, it will default to 5 or 6, depending on platform, for both float and double.
-    // So we set our own more useful defaults:
-    size_t default_precision = sizeof(T) == sizeof(float) ? 6 : 12;
-    ss << std::setprecision(decimals <= 0 ? default_precision : decimals);
-    ss << x;
-    auto s = ss.str();
+    // It defaults to 6, for both float and double. So we set our own more useful defaults:
+    int default_precision = sizeof(T) == sizeof(float) ? 6 : 12;
+    int precision = decimals <= 0 ? default_precision : decimals;
+    char buf[128];
+    auto s = buf;
+    string big;
+    auto len = snprintf(buf, sizeof(buf), "%.*f", precision, (double)x);
+    if (len < 0) return;
+    if ((size_t)len >= sizeof(buf))
+    {
+        // Huge numbers, or huge numbers of decimals requested.
+        big.resize(len + 1);
+        s = &big[0];
+        snprintf(s, len + 1, "%.*f", precision, (double)x);
+    }
     if (decimals <= 0)
     {
-        // First trim whatever lies beyond the precision to avoid garbage digits.
-        size_t max_significant = default_precision;
+        // First trim whatever lies beyond the precision to avoid garbage digits, but never the integer part.
+        int max_significant = default_precision;
         max_significant += 2;  // "0."
         if (s[0] == '-') max_significant++;
-        if (s.length() > max_significant) s.erase(max_significant);
+        auto dot = (const char *)memchr(s, '.', len);
+        if (dot) max_significant = max(max_significant, (int)(dot - s) + 2);
+        if (len > max_significant) len = max_significant;
         // Now strip unnecessary trailing zeroes.
-        while (s.back() == '0') s.pop_back();
+        while (len > 1 && s[len - 1] == '0') len--;
         // If there were only zeroes, keep at least 1.
-        if (s.back() == '.') s.push_back('0');
+        if (s[len - 1] == '.') s[len++] = '0';
     }
+    sd.append(s, len);
+}
+
+// Special case for to_string to get exact float formatting we need.
+template<typename T> string to_string_float(T x, int decimals = -1)
+{
+    string s;
+    append_float(s, x, decimals);
     return s;
 }
 
@@ -266,6 +341,55 @@ inline string to_string_hex(size_t x)
     return ss.str();
 }
 
+// 64-bit FNV-1a, used for content hashes (e.g. the compiled bytecode cache). Not cryptographic.
+inline uint64_t FNV1A64(const void *data, size_t len, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+    auto p = (const uchar *)data;
+    for (size_t i = 0; i < len; i++) { hash ^= p[i]; hash *= 0x100000001b3ULL; }
+    return hash;
+}
+
+// Index of the lowest set bit, e.g. to find the first match in a SIMD comparison mask. mask must not be 0.
+inline int LowestBit(uint mask)
+{
+    #ifdef _MSC_VER
+        unsigned long i;
+        _BitScanForward(&i, mask);
+        return (int)i;
+    #else
+        return __builtin_ctz(mask);
+    #endif
+}
+
+inline int PopCount(uint val)
+{
+    #ifdef _MSC_VER
+        return (int)__popcnt(val);
+    #else
+        return __builtin_popcount(val);
+    #endif
+}
+
+// Calls f(begin, end) on consecutive ranges that together cover [0, n), on all cores where available.
+// Ranges are at least mingrain long, so small amounts of work don't pay for starting threads.
+template<typename F> void ParallelFor(size_t n, size_t mingrain, const F &f)
+{
+    #ifdef PLATFORM_THREADS
+        auto numthreads = min<size_t>(max(1u, thread::hardware_concurrency()), n / max<size_t>(mingrain, 1));
+        if (numthreads > 1)
+        {
+            auto chunk = (n + numthreads - 1) / numthreads;
+            vector<thread> workers;
+            for (auto b = chunk; b < n; b += chunk)
+                workers.emplace_back([=, &f]() { f(b, min(b + chunk, n)); });
+            f(0, chunk);
+            for (auto &w : workers) w.join();
+            return;
+        }
+    #endif
+    f(0, n);
+}
+
 /* Accumulator: a container that is great for accumulating data like std::vector,
    but without the reallocation/copying and unused memory overhead.
    Instead stores elements as a 2-way growing list of blocks.
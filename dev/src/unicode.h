@@ -14,6 +14,10 @@
 
 // To and from UTF-8 unicode conversion functions
 
+#ifdef PLATFORM_SSE2
+    #include <emmintrin.h>
+#endif
+
 inline int ToUTF8(int u, char *out /* must have space for 7 chars */)
 {
     assert(u >= 0);                   // top bit can't be set
@@ -43,6 +47,7 @@ inline int FromUTF8(const char *&in)  // returns -1 upon corrupt UTF-8 encoding
     }
     if ((*in << len) & 0x80) return -1;      // bit after leading 1's must be 0
     if (!len) return *in++;
+    if (len == 1) return -1;                 // a continuation byte can't start a code point
     int r = *in++ & ((1 << (7 - len)) - 1);  // grab initial bits of the code
     for (int i = 0; i < len - 1; i++)
     {
@@ -53,6 +58,81 @@ inline int FromUTF8(const char *&in)  // returns -1 upon corrupt UTF-8 encoding
     return r;
 }
 
+// Bulk versions of the above, for whole strings at a time. These handle embedded 0 bytes, and accept the same
+// encodings as FromUTF8, i.e. up to 6 bytes per code point.
+
+// Number of bytes in the encoding of u.
+inline int UTF8EncodedLen(int u)
+{
+    return u < 0x80 ? 1 : u < 0x800 ? 2 : u < 0x10000 ? 3 : u < 0x200000 ? 4 : u < 0x4000000 ? 5 : 6;
+}
+
+// Number of bytes in the encoding that starts with c, or 0 if c can't start one.
+inline int UTF8SeqLen(uchar c)
+{
+    return c < 0x80 ? 1 : c < 0xC0 ? 0 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : c < 0xF8 ? 4 : c < 0xFC ? 5 : c < 0xFE ? 6 : 0;
+}
+
+// Returns the number of code points in s, or -1 upon corrupt UTF-8 encoding. Runs of ASCII are checked 16 bytes at
+// a time.
+inline int UTF8Length(const char *s, size_t len)
+{
+    auto p = (const uchar *)s;
+    auto end = p + len;
+    int num = 0;
+    while (p < end)
+    {
+        #ifdef PLATFORM_SSE2
+            while (end - p >= 16 && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p))) { p += 16; num += 16; }
+            if (p == end) break;
+        #endif
+        int n = UTF8SeqLen(*p);
+        if (!n || end - p < n) return -1;
+        for (int i = 1; i < n; i++) if ((p[i] & 0xC0) != 0x80) return -1;
+        p += n;
+        num++;
+    }
+    return num;
+}
+
+// Decodes one code point from a string that passed UTF8Length.
+inline int DecodeUTF8(const uchar *&p)
+{
+    int n = UTF8SeqLen(*p);
+    if (n == 1) return *p++;
+    int r = *p++ & (0x7F >> n);
+    while (--n) r = (r << 6) | (*p++ & 0x3F);
+    return r;
+}
+
+// Returns the byte offset at which code point i starts, len if i is the number of code points, or -1 beyond that.
+// Since this only needs to count the bytes that start a code point, it doesn't validate, and can count them 16 at a
+// time whatever the text.
+inline int UTF8Offset(const char *s, size_t len, int i)
+{
+    if (i < 0) return -1;
+    auto p = (const uchar *)s;
+    auto end = p + len;
+    #ifdef PLATFORM_SSE2
+        auto top2 = _mm_set1_epi8((char)0xC0);
+        auto cont = _mm_set1_epi8((char)0x80);
+        for (; end - p >= 16; p += 16)
+        {
+            auto block = _mm_loadu_si128((const __m128i *)p);
+            uint starts = ~_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(block, top2), cont)) & 0xFFFF;
+            int n = PopCount(starts);
+            if (i < n)
+            {
+                while (i--) starts &= starts - 1;
+                return int(p - (const uchar *)s) + LowestBit(starts);
+            }
+            i -= n;
+        }
+    #endif
+    for (; p < end; p++) if ((*p & 0xC0) != 0x80 && !i--) return int(p - (const uchar *)s);
+    return i ? -1 : (int)len;
+}
+
 // convenience functions
 
 inline string ToUTF8(const wchar_t *in)
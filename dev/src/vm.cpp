@@ -225,8 +225,10 @@ struct VM : VMBase
                         case V_VECTOR:
                         case V_STRUCT:
                         {
-                            auto s = RefToString(ro, leakpp);
-                            fputs((ro->CycleStr() + " = " + s + "\n").c_str(), leakf);
+                            auto s = ro->CycleStr() + " = ";
+                            RefToString(s, ro, leakpp);
+                            s += "\n";
+                            fputs(s.c_str(), leakf);
                             break;
                         }
 
@@ -251,7 +253,7 @@ struct VM : VMBase
     }
     LString *NewString(size_t l)
     {
-        return new (vmpool->alloc(sizeof(LString) + l + 1)) LString((int)l); 
+        return new (vmpool->alloc(LString::AllocSize((int)l))) LString((int)l);
     }
     CoRoutine *NewCoRoutine(const int *rip, const int *vip, CoRoutine *p, const TypeInfo &cti)
     {
@@ -308,7 +310,11 @@ struct VM : VMBase
         while (sp >= 0 && (!stackframes.size() || sp != stackframes.back().spstart))
         {
             s += "\n   stack: " + to_string_hex((size_t)TOP().any());  // Sadly can't print this properly.
-            if (vmpool->pointer_is_in_allocator(TOP().any())) s += ", maybe: " + RefToString(TOP().ref(), debugpp);
+            if (vmpool->pointer_is_in_allocator(TOP().any()))
+            {
+                s += ", maybe: ";
+                RefToString(s, TOP().ref(), debugpp);
+            }
             POP();  // We don't DEC here, as we can't know what type it is.
                     // This is ok, as we ignore leaks in case of an error anyway.
         }
@@ -339,7 +345,7 @@ struct VM : VMBase
 
         for (size_t i = 0; i < bcf->specidents()->size(); i++)
         {
-            s += DumpVar(vars[i], i, true);
+            DumpVar(s, vars[i], i, true);
         }
 
         throw s;
@@ -376,13 +382,15 @@ struct VM : VMBase
         return RefToString(a, debugpp);
     }
 
-    string DumpVar(const Value &x, size_t idx, uchar dumpglobals)
+    void DumpVar(string &sd, const Value &x, size_t idx, uchar dumpglobals)
     {
         auto sid = bcf->specidents()->Get((uint)idx);
         auto id = bcf->idents()->Get(sid->ididx());
-        if (id->readonly() || id->global() != dumpglobals) return "";
-        string name = id->name()->c_str();
-        return "\n   " + name + " = " + x.ToString(GetVarTypeInfo((int)idx).t, debugpp);
+        if (id->readonly() || id->global() != dumpglobals) return;
+        sd += "\n   ";
+        sd += id->name()->c_str();
+        sd += " = ";
+        x.ToString(sd, GetVarTypeInfo((int)idx).t, debugpp);
     }
 
     void EvalMulti(int nargs, const int *mip, int definedfunction, const int *retip, int tempmask)
@@ -482,14 +490,14 @@ struct VM : VMBase
         while (ndef--)
         {
             auto i = *--defvars; 
-            if (error) (*error) += DumpVar(vars[i], i, false);
+            if (error) DumpVar(*error, vars[i], i, false);
             else vars[i].DECTYPE(GetVarTypeInfo(i).t);
             vars[i] = POP();
         }
         while (nargs--)
         {
             auto i = *--freevars;
-            if (error) (*error) += DumpVar(vars[i], i, false);
+            if (error) DumpVar(*error, vars[i], i, false);
             else vars[i].DECTYPE(GetVarTypeInfo(i).t);
             vars[i] = POP();
         } 
@@ -724,7 +732,8 @@ struct VM : VMBase
 
     void EndEval(Value &ret, ValueType vt)
     {
-        evalret = ret.ToString(vt, programprintprefs);
+        evalret.clear();
+        ret.ToString(evalret, vt, programprintprefs);
         ret.DECTYPE(vt);
         assert(sp == -1);
         FinalStackVarsCleanup();
@@ -796,8 +805,8 @@ struct VM : VMBase
                     trace_output += to_string(sp + 1);
                     trace_output += "] - ";
                     #if RTT_ENABLED
-                    if (sp >= 0) { auto x = TOP();   trace_output += x.ToString(x.type, debugpp); }
-                    if (sp >= 1) { auto x = TOPM(1); trace_output += " "; trace_output += x.ToString(x.type, debugpp); }
+                    if (sp >= 0) { auto x = TOP();   x.ToString(trace_output, x.type, debugpp); }
+                    if (sp >= 1) { auto x = TOPM(1); trace_output += " "; x.ToString(trace_output, x.type, debugpp); }
                     #endif
                     if (trace_tail)
                     {
@@ -1020,16 +1029,25 @@ struct VM : VMBase
                 #define _IOP(op, extras)  TYPEOP(op, extras, ival(), VMASSERT(a.type == V_INT && b.type == V_INT))
                 #define _FOP(op, extras)  TYPEOP(op, extras, fval(), VMASSERT(a.type == V_FLOAT && b.type == V_FLOAT))
 
-                #define _VELEM(a, i, isfloat, T) (isfloat ? (T)a.eval()->At(i).fval() : (T)a.eval()->At(i).ival())
+                #define _VELEM(e, isfloat, T) (isfloat ? (T)(e).fval() : (T)(e).ival())
+                // Element pointers are looked up once, the loop itself is then simple enough for the compiler to
+                // unroll.
                 #define _VOP(op, extras, T, isfloat, withscalar, comp) Value res; { \
                     int len = VectorLoop(a, b, res, withscalar, comp ? GetTypeInfo(TYPE_ELEM_VECTOR_OF_INT) : a.eval()->ti); \
-                    for (int j = 0; j < len; j++) \
+                    if (withscalar) VMTYPEEQ(b, isfloat ? V_FLOAT : V_INT); \
+                    if (len) \
                     { \
-                        if (withscalar) VMTYPEEQ(b, isfloat ? V_FLOAT : V_INT) else VMTYPEEQ(b.eval()->At(j), isfloat ? V_FLOAT : V_INT); \
-                        auto bv = withscalar ? (isfloat ? (T)b.fval() : (T)b.ival()) : _VELEM(b, j, isfloat, T); \
-                        if (extras&1 && bv == 0) Div0(); \
-                        VMTYPEEQ(a.eval()->At(j), isfloat ? V_FLOAT : V_INT); \
-                        res.eval()->At(j) = Value(_VELEM(a, j, isfloat, T) op bv); \
+                        auto av = &a.eval()->At(0); \
+                        auto bvs = withscalar ? &b : &b.eval()->At(0); \
+                        auto rv = &res.eval()->At(0); \
+                        for (int j = 0; j < len; j++) \
+                        { \
+                            if (!withscalar) VMTYPEEQ(bvs[j], isfloat ? V_FLOAT : V_INT); \
+                            auto bv = _VELEM(bvs[withscalar ? 0 : j], isfloat, T); \
+                            if (extras&1 && bv == 0) Div0(); \
+                            VMTYPEEQ(av[j], isfloat ? V_FLOAT : V_INT); \
+                            rv[j] = Value(_VELEM(av[j], isfloat, T) op bv); \
+                        } \
                     } \
                     a.DECRT(); \
                     if (!withscalar) b.DECRT(); \
@@ -1152,7 +1170,7 @@ struct VM : VMBase
                         for (int i = 0; i < len; i++) \
                         { \
                             VMTYPEEQ(a.eval()->At(i), isfloat ? V_FLOAT : V_INT); \
-                            res.eval()->At(i) = Value(-_VELEM(a, i, isfloat, type)); \
+                            res.eval()->At(i) = Value(-_VELEM(a.eval()->At(i), isfloat, type)); \
                         } \
                         a.DECRT(); \
                         PUSH(res); \
@@ -1186,6 +1204,23 @@ struct VM : VMBase
                 case IL_ASR:    BITOP(>>);
                 case IL_NEG:    { auto a = POP(); PUSH(~a.ival()); break; }
 
+                // Scalar math builtins the codegen turns into opcodes, to skip the BCALL overhead.
+                #define MATHOP1(exp) { Value a = POP(); PUSH(Value(exp)); break; }
+                #define MATHOP2(exp) { GETARGS(); PUSH(Value(exp)); break; }
+                #define MATHOP3(exp) { Value c = POP(); GETARGS(); PUSH(Value(exp)); break; }
+                case IL_FSQRT:  MATHOP1(sqrtf(a.fval()));
+                case IL_FSIN:   MATHOP1(sinf(a.fval() * RAD));
+                case IL_FCOS:   MATHOP1(cosf(a.fval() * RAD));
+                case IL_IABS:   MATHOP1(abs(a.ival()));
+                case IL_FABS:   MATHOP1(fabsf(a.fval()));
+                case IL_IMIN:   MATHOP2(min(a.ival(), b.ival()));
+                case IL_IMAX:   MATHOP2(max(a.ival(), b.ival()));
+                case IL_FMIN:   MATHOP2(min(a.fval(), b.fval()));
+                case IL_FMAX:   MATHOP2(max(a.fval(), b.fval()));
+                case IL_ICLAMP: MATHOP3(max(min(a.ival(), c.ival()), b.ival()));
+                case IL_FCLAMP: MATHOP3(max(min(a.fval(), c.fval()), b.fval()));
+                case IL_FLERP:  MATHOP3(mix(a.fval(), b.fval(), c.fval()));
+
                 case IL_I2F:
                 {
                     Value a = POP();
@@ -1198,7 +1233,9 @@ struct VM : VMBase
                 {
                     Value a = POP();
                     TYPE_ASSERT(IsRefNil(a.type));
-                    PUSH(NewString(a.ToString(a.ref() ? a.ref()->ti.t : V_NIL, programprintprefs)));
+                    printbuf.clear();
+                    RefToString(printbuf, a.ref(), programprintprefs);
+                    PUSH(NewString(printbuf));
                     a.DECRTNIL();
                     break;
                 }
@@ -1369,6 +1406,19 @@ struct VM : VMBase
         vec.DECRT();
     }
 
+    // s += b: if nothing else refers to s, and b fits in its current allocation, no need to copy s.
+    bool AppendInPlace(Value &a, Value &b)
+    {
+        auto s = a.sval();
+        auto t = b.sval();
+        if (s->refc != 1 || LString::AllocSize(s->len) != LString::AllocSize(s->len + t->len)) return false;
+        memcpy(s->str() + s->len, t->str(), t->len);
+        s->len += t->len;
+        s->str()[s->len] = 0;
+        b.DECRT();
+        return true;
+    }
+
     void LvalueOp(int op, Value &a)
     {
         switch(op)
@@ -1429,8 +1479,8 @@ struct VM : VMBase
             case LVO_FDIV:    { Value b = POP();  _FOP(/, 1);                a = res;                    break; }
             case LVO_FDIVR:   { Value b = POP();  _FOP(/, 1);                a = res; PUSH(res);         break; }
                                                                             
-            case LVO_SADD:    { Value b = POP();  _SCAT();                   a = res;                    break; }
-            case LVO_SADDR:   { Value b = POP();  _SCAT();                   a = res; PUSH(res.INCRT()); break; }
+            case LVO_SADD:    { Value b = POP(); if (!AppendInPlace(a, b)) { _SCAT(); a = res; }                    break; }
+            case LVO_SADDR:   { Value b = POP(); if (!AppendInPlace(a, b)) { _SCAT(); a = res; } PUSH(a.INCRT()); break; }
 
             case LVO_WRITE:     { Value  b = POP();                          a = b; break; }
             case LVO_WRITER:    { Value &b = TOP();                          a = b; break; }
@@ -1526,6 +1576,11 @@ struct VM : VMBase
         return bcf->structs()->Get(ti.structidx)->name()->c_str();
     }
 
+    const char *StructFieldName(const TypeInfo &ti, int field)
+    {
+        return bcf->structs()->Get(ti.structidx)->fieldnames()->Get(field)->c_str();
+    }
+
     virtual const char *ReverseLookupType(uint v)
     {
         return bcf->structs()->Get(v)->name()->c_str();
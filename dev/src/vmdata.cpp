@@ -82,36 +82,92 @@ bool Value::Equal(ValueType vtype, const Value &o, ValueType otype, bool structu
     }
 }
 
-string RefToString(const RefObj *ro, PrintPrefs &pp)
+// Consistent with structural equality: values that are equal() hash the same.
+static uint64_t IntHash(int i) { return FNV1A64(&i, sizeof(int)); }
+
+static uint64_t FloatHash(float f)
 {
-    if (!ro) return "nil";
+    if (f == 0) f = 0;  // -0.0 == 0.0
+    return FNV1A64(&f, sizeof(float));
+}
 
-    switch (ro->ti.t)
+uint64_t RefHash(const RefObj *a)
+{
+    if (!a) return 0;
+
+    switch (a->ti.t)
     {
-        case V_BOXEDINT:   { auto s = to_string(((BoxedInt *)ro)->val);                      return pp.anymark ? "#" + s : s; }
-        case V_BOXEDFLOAT: { auto s = to_string_float(((BoxedFloat *)ro)->val, pp.decimals); return pp.anymark ? "#" + s : s; }
+        case V_BOXEDINT:    return IntHash(((BoxedInt *)a)->val);
+        case V_BOXEDFLOAT:  return FloatHash(((BoxedFloat *)a)->val);
+        case V_STRING:      return FNV1A64(((LString *)a)->str(), ((LString *)a)->len);
+        case V_VECTOR:
+        case V_STRUCT:      return ((ElemObj *)a)->Hash();
+        default:            return FNV1A64(&a, sizeof(const RefObj *));
+    }
+}
 
-        case V_STRING:     return ((LString *)ro)->ToString(pp);
-        case V_COROUTINE:  return "(coroutine)";
+uint64_t Value::Hash(ValueType vtype) const
+{
+    switch (vtype)
+    {
+        case V_INT: return IntHash((int)ival_);
+        case V_FLOAT: return FloatHash((float)fval_);
+        case V_FUNCTION: return FNV1A64(&ip_, sizeof(ip_));
+        default: return RefHash(refnil());
+    }
+}
+
+// Printing appends to sd rather than returning strings, so nested values don't create temporaries.
+void RefToString(string &sd, const RefObj *ro, PrintPrefs &pp)
+{
+    if (!ro) { sd += "nil"; return; }
+
+    switch (ro->ti.t)
+    {
+        case V_BOXEDINT:
+            if (pp.anymark) sd += '#';
+            append_int(sd, ((BoxedInt *)ro)->val);
+            break;
+        case V_BOXEDFLOAT:
+            if (pp.anymark) sd += '#';
+            append_float(sd, ((BoxedFloat *)ro)->val, pp.decimals);
+            break;
+
+        case V_STRING:     ((LString *)ro)->ToString(sd, pp); break;
+        case V_COROUTINE:  sd += "(coroutine)"; break;
         case V_VECTOR:
-        case V_STRUCT:     return ((ElemObj *)ro)->ToString(pp);
-        default:           return string("(") + BaseTypeName(ro->ti.t) + ")";
+        case V_STRUCT:     ((ElemObj *)ro)->ToString(sd, pp); break;
+        default:           sd += '('; sd += BaseTypeName(ro->ti.t); sd += ')'; break;
     }
 }
 
-string Value::ToString(ValueType vtype, PrintPrefs &pp) const
+string RefToString(const RefObj *ro, PrintPrefs &pp)
 {
-    if (IsRefNil(vtype)) return ref_ ? RefToString(ref_, pp) : "nil";
+    string sd;
+    RefToString(sd, ro, pp);
+    return sd;
+}
+
+void Value::ToString(string &sd, ValueType vtype, PrintPrefs &pp) const
+{
+    if (IsRefNil(vtype)) { RefToString(sd, ref_, pp); return; }
 
     switch (vtype)
     {
-        case V_INT:        return to_string(ival());                   
-        case V_FLOAT:      return to_string_float(fval(), pp.decimals);
-        case V_FUNCTION:   return "<FUNCTION>";
-        default:           return string("(") + BaseTypeName(vtype) + ")";
+        case V_INT:        append_int(sd, ival()); break;
+        case V_FLOAT:      append_float(sd, fval(), pp.decimals); break;
+        case V_FUNCTION:   sd += "<FUNCTION>"; break;
+        default:           sd += '('; sd += BaseTypeName(vtype); sd += ')'; break;
     }
 }
 
+string Value::ToString(ValueType vtype, PrintPrefs &pp) const
+{
+    string sd;
+    ToString(sd, vtype, pp);
+    return sd;
+}
+
 
 void RefObj::Mark()
 {
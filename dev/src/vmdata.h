@@ -129,6 +129,7 @@ struct VMBase
     PrintPrefs programprintprefs;
     const type_elem_t *typetable;
     string evalret;
+    string printbuf;  // Reused for converting values to strings, to avoid allocating a new string each time.
 
     VMBase() : programprintprefs(10, 10000, false, -1, false), typetable(nullptr) {}
     virtual ~VMBase() {}
@@ -139,6 +140,7 @@ struct VMBase
     virtual Value BuiltinError(string err) = 0;
     virtual void Push(const Value &v) = 0;
     virtual Value Pop() = 0;
+    virtual LString *NewString(size_t l) = 0;  // Uninitialized contents.
     virtual LString *NewString(const string &s) = 0;
     virtual LString *NewString(const char *c, size_t l) = 0;
     virtual ElemObj *NewVector(int initial, int max, const TypeInfo &ti) = 0;
@@ -155,6 +157,7 @@ struct VMBase
     virtual const char *GetProgramName() = 0;
     virtual void LogFrame() = 0;
     virtual string StructName(const TypeInfo &ti) = 0;
+    virtual const char *StructFieldName(const TypeInfo &ti, int field) = 0;
     virtual const TypeInfo &GetVarTypeInfo(int varidx) = 0;
     virtual void CoVarCleanup(CoRoutine *co) = 0;
     virtual void EvalProgram() = 0;
@@ -203,6 +206,8 @@ struct RefObj : DynAlloc
 };
 
 extern bool RefEqual(const RefObj *a, const RefObj *b, bool structural);
+extern uint64_t RefHash(const RefObj *a);
+extern void RefToString(string &sd, const RefObj *ro, PrintPrefs &pp);
 extern string RefToString(const RefObj *ro, PrintPrefs &pp);
 
 struct BoxedInt : RefObj
@@ -223,49 +228,74 @@ struct LString : RefObj
 {
     int len;    // has to match the Value integer type, since we allow the length to be obtained
 
+    // Longer strings are allocated in size classes a quarter of a power of 2 apart, so appending to a string nobody
+    // else refers to (s += x) can mostly happen in place, making repeated appends linear rather than quadratic.
+    // The size has to be derivable from len alone, since it is not stored.
+    static size_t AllocSize(int l)
+    {
+        size_t size = sizeof(LString) + l + 1;
+        if (size <= 256) return size;
+        size_t step = 1;
+        while (step * 8 <= size) step *= 2;
+        return (size + step - 1) & ~(step - 1);
+    }
+
     LString(int _l) : RefObj(g_vm->GetTypeInfo(TYPE_ELEM_STRING)), len(_l) {}
 
     char *str() { return (char *)(this + 1); }
 
-    string ToString(PrintPrefs &pp)
+    void ToString(string &sd, PrintPrefs &pp)
     {
         if (pp.cycles >= 0)
         {
             if (refc < 0)
-                return CycleStr(); 
+            {
+                sd += CycleStr();
+                return;
+            }
             CycleDone(pp.cycles);
         }
-        string s = len > pp.budget ? string(str()).substr(0, pp.budget) + ".." : str();
+        auto s = str();
+        auto n = strlen(s);
+        bool truncated = len > pp.budget;
+        if (truncated) n = min(n, (size_t)max(pp.budget, 0));
         if (pp.quoted)
         {
-            string r = "\"";
-            for (size_t i = 0; i < s.length(); i++) switch(s[i])
+            sd += '\"';
+            auto end = s + n;
+            while (s < end)
             {
-                case '\n': r += "\\n"; break;
-                case '\t': r += "\\t"; break;
-                case '\r': r += "\\r"; break;
-                case '\\': r += "\\\\"; break;
-                case '\"': r += "\\\""; break;
-                case '\'': r += "\\\'"; break;
-                default:
-                    if (s[i] >= ' ' && s[i] <= '~') r += s[i];
-                    else { 
-                        r += "\\x"; r += HexChar(((uchar)s[i]) >> 4); r += HexChar(s[i] & 0xF); }
-                    break;
+                // Copy runs of characters that don't need escaping in one go.
+                auto plain = s;
+                while (plain < end && *plain >= ' ' && *plain <= '~' &&
+                       *plain != '\\' && *plain != '\"' && *plain != '\'') plain++;
+                sd.append(s, plain);
+                if (plain == end) break;
+                s = plain + 1;
+                switch (*plain)
+                {
+                    case '\n': sd += "\\n"; break;
+                    case '\t': sd += "\\t"; break;
+                    case '\r': sd += "\\r"; break;
+                    case '\\': sd += "\\\\"; break;
+                    case '\"': sd += "\\\""; break;
+                    case '\'': sd += "\\\'"; break;
+                    default: sd += "\\x"; sd += HexChar(((uchar)*plain) >> 4); sd += HexChar(*plain & 0xF); break;
+                }
             }
-
-            r += "\"";
-            return r; 
+            if (truncated) sd += "..";
+            sd += '\"';
         }
         else
         {
-            return s;
+            sd.append(s, n);
+            if (truncated) sd += "..";
         }
     }
 
     char HexChar(char i) { return i + (i < 10 ? '0' : 'A' - 10); }
 
-    void DeleteSelf() { vmpool->dealloc(this, sizeof(LString) + len + 1); }
+    void DeleteSelf() { vmpool->dealloc(this, AllocSize(len)); }
 
     bool operator==(LString &o) { return strcmp(str(), o.str()) == 0; }
     bool operator!=(LString &o) { return strcmp(str(), o.str()) != 0; }
@@ -369,8 +399,10 @@ struct Value
         return ip_[1];
     }
 
+    void ToString(string &sd, ValueType vtype, PrintPrefs &pp) const;
     string ToString(ValueType vtype, PrintPrefs &pp) const;
     bool Equal(ValueType vtype, const Value &o, ValueType otype, bool structural) const;
+    uint64_t Hash(ValueType vtype) const;
     void Mark(ValueType vtype);
 };
 
@@ -456,32 +488,57 @@ struct ElemObj : RefObj
         return true;
     }
 
+    uint64_t Hash()
+    {
+        int len = Len();
+        auto h = FNV1A64(&len, sizeof(int));
+        for (int i = 0; i < len; i++)
+        {
+            auto eh = At(i).Hash(ElemType(i));
+            h = FNV1A64(&eh, sizeof(uint64_t), h);
+        }
+        return h;
+    }
+
     void Mark()
     {
         for (int i = 0; i < Len(); i++)
             At(i).Mark(ElemType(i));
     }
 
-    string ToString(PrintPrefs &pp)
+    void ToString(string &sd, PrintPrefs &pp)
     {
         if (pp.cycles >= 0)
         {
             if (refc < 0)
-                return CycleStr();
+            {
+                sd += CycleStr();
+                return;
+            }
             CycleDone(pp.cycles);
         }
 
-        string s = ti.t == V_STRUCT ? g_vm->ReverseLookupType(ti.structidx) + string("{") : "[";
+        // The budget applies to what this object prints, not to what was in sd before.
+        auto start = sd.size();
+        if (ti.t == V_STRUCT)
+        {
+            sd += g_vm->ReverseLookupType(ti.structidx);
+            sd += '{';
+        }
+        else
+        {
+            sd += '[';
+        }
         for (int i = 0; i < Len(); i++)
         {
-            if (i) s += ", ";
-            if ((int)s.size() > pp.budget) { s += "...."; break; }
-            PrintPrefs subpp(pp.depth - 1, pp.budget - (int)s.size(), true, pp.decimals, pp.anymark);
-            s += pp.depth || !IsRef(ElemType(i)) ? At(i).ToString(ElemType(i), subpp) : "..";
+            if (i) sd += ", ";
+            auto used = (int)(sd.size() - start);
+            if (used > pp.budget) { sd += "...."; break; }
+            PrintPrefs subpp(pp.depth - 1, pp.budget - used, true, pp.decimals, pp.anymark);
+            if (pp.depth || !IsRef(ElemType(i))) At(i).ToString(sd, ElemType(i), subpp);
+            else sd += "..";
         }
-        s += ti.t == V_STRUCT ? "}" : "]";
-
-        return s;
+        sd += ti.t == V_STRUCT ? '}' : ']';
     }
 };
 